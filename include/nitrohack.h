@@ -35,6 +35,7 @@
 
 /* allmain.c */
 extern EXPORT void nh_lib_init(const struct nh_window_procs *, char **paths);
+extern EXPORT nh_bool nh_preload_data(void);
 extern EXPORT void nh_lib_exit(void);
 extern EXPORT nh_bool nh_exit_game(int exit_type);
 extern EXPORT enum nh_restore_status nh_restore_game(int fd,
@@ -43,6 +44,7 @@ extern EXPORT enum nh_restore_status nh_restore_game(int fd,
 extern EXPORT nh_bool nh_start_game(int fd, const char *name, int role, int race,
 				    int gend, int align, enum nh_game_modes playmode);
 extern EXPORT int nh_command(const char *cmd, int rep, struct nh_cmd_arg *arg);
+extern EXPORT nh_bool nh_get_game_info(struct nh_game_info *gi);
 extern EXPORT const char *const *nh_get_copyright_banner(void);
 
 /* logreplay.c */
@@ -51,8 +53,13 @@ extern EXPORT nh_bool nh_view_replay_start(int fd, struct nh_window_procs *rwinp
 extern EXPORT nh_bool nh_view_replay_step(struct nh_replay_info *info,
 					  enum replay_control action, int count);
 extern EXPORT void nh_view_replay_finish(void);
+extern EXPORT void nh_view_replay_set_index(int fd);
 extern EXPORT enum nh_log_status nh_get_savegame_status(int fd, struct nh_game_info *si);
 
+/* log.c */
+extern EXPORT void nh_configure_log(int compression_level, nh_bool async_write,
+				    int header_every);
+
 /* cmd.c */
 extern EXPORT struct nh_cmd_desc *nh_get_commands(int *count);
 extern EXPORT struct nh_cmd_desc *nh_get_object_commands(int *count, char invlet);
@@ -36,6 +36,39 @@ enum authresult {
 };
 
 
+/*
+ * Compact encoding of "update_screen" map data. The server offers it with
+ * "features": ["dbuf_bin"] in its auth response, and the client turns it on
+ * with the "set_features" command. The "dbuf_bin" string is base64 of:
+ *   header: flags byte, payload length (16 bit little endian)
+ *   payload, zlib-compressed if DBUF_BIN_ZLIB is set:
+ *     a bitmask of the changed map cells, one bit per cell, row by row
+ *     for each changed cell: a 16 bit field mask (DBUF_BIN_F_*), followed by
+ *     the new values of those fields; effect is 32 bits, invis 8 bits and
+ *     the rest are 16 bits, all little endian.
+ */
+#define NHNET_FEATURE_DBUF_BIN "dbuf_bin"
+
+#define DBUF_BIN_ZLIB		0x01 /* the payload is zlib-compressed */
+#define DBUF_BIN_KEYFRAME	0x02 /* changes are relative to an empty map */
+
+#define DBUF_BIN_F_EFFECT	0x001
+#define DBUF_BIN_F_BG		0x002
+#define DBUF_BIN_F_TRAP		0x004
+#define DBUF_BIN_F_OBJ		0x008
+#define DBUF_BIN_F_OBJ_MN	0x010
+#define DBUF_BIN_F_OBJFLAGS	0x020
+#define DBUF_BIN_F_MON		0x040
+#define DBUF_BIN_F_MONFLAGS	0x080
+#define DBUF_BIN_F_INVIS	0x100
+#define DBUF_BIN_F_DGNFLAGS	0x200
+
+#define DBUF_BIN_HEADER_LEN	3
+#define DBUF_BIN_MASK_LEN	((ROWNO * COLNO + 7) / 8)
+#define DBUF_BIN_CELL_MAX	(2 + 4 + 8 * 2 + 1)
+#define DBUF_BIN_PAYLOAD_MAX	(DBUF_BIN_MASK_LEN + ROWNO * COLNO * DBUF_BIN_CELL_MAX)
+
+
 struct nhnet_game {
     int gameid;
     enum nh_log_status status;
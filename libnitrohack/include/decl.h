@@ -447,12 +447,26 @@ enum memfile_tagtype {
 };
 
 struct memfile_tag {
-    struct memfile_tag *next;
+    int next;		/* index of the next tag in the chain, or -1 */
     long tagdata;
     enum memfile_tagtype tagtype;
     int pos;
 };
 
+/*
+ * A section is a byte range of a memfile that was recorded by the caller
+ * (currently: one per level).  If the data in a section is known not to have
+ * changed, a diff memfile can copy it out of its parent with mcopy_section()
+ * instead of serializing it again.  The tags that were created inside the
+ * section are tagslab[firsttag .. firsttag+ntags-1].
+ */
+struct memfile_section {
+    int start;		/* -1 if the section was not recorded */
+    int end;
+    int firsttag;
+    int ntags;
+};
+
 /* The basic information: the buffer, its length, and the file position. */
 struct memfile {
     char *buf;
@@ -497,8 +511,18 @@ struct memfile {
      * Tags are NOT saved with save files.  Instead, they link
      * the same save sections between the current and previous memfiles,
      * emitting MDIFF_SEEK commands to reduce redundant diff output.
+     *
+     * The tags themselves live in tagslab, in the order they were created
+     * (so sections can find theirs); the hashtable and the chains hold
+     * indices into it, so the slab can be reallocated as it grows.
      */
-    struct memfile_tag *tags[MEMFILE_HASHTABLE_SIZE];
+    int tags[MEMFILE_HASHTABLE_SIZE];
+    struct memfile_tag *tagslab;
+    int ntags;
+    int tagslablen;
+
+    struct memfile_section *sections;
+    int nsections;
 };
 
 extern int logfile;
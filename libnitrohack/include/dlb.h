@@ -21,6 +21,7 @@ typedef struct dlb_library {
     long nentries;	/* # of files in directory */
     long rev;		/* dlb file revision */
     long strsize;	/* dlb file string size */
+    char *mem;		/* whole library file, if preloaded */
 } library;
 
 /* library definitions */
@@ -44,6 +45,7 @@ typedef struct dlb_handle {
 #define DLB_P dlb *
 
 boolean dlb_init(void);
+boolean dlb_preload(void);
 void dlb_cleanup(void);
 
 dlb *dlb_fopen(const char *,const char *);
@@ -748,6 +748,8 @@ extern void new_light_source(struct level *lev, xchar x, xchar y,
 			     int range, int type, void *id);
 extern void del_light_source(struct level *lev, int type, void *id);
 extern void do_light_sources(char **);
+extern void light_sources_topology_changed(int, int);
+extern void flush_light_cache(void);
 extern struct monst *find_mid(struct level *lev, unsigned nid, unsigned fmflags);
 extern void transfer_lights(struct level *oldlev, struct level *newlev,
 			    unsigned int obj_id);
@@ -791,6 +793,8 @@ extern void log_timezone(int tz_offset);
 extern void log_command_result(void);
 extern void log_revert_command(void);
 extern void log_option(struct nh_option_desc *opt);
+extern char *log_encode_option(struct nh_option_desc *opt);
+extern void log_save_options(int fd);
 extern void log_getpos(int ret, int x, int y);
 extern void log_getdir(enum nh_direction dir);
 extern void log_query_key(char key, int *count);
@@ -802,6 +806,7 @@ extern void log_bones(const char *bonesbuf, int buflen);
 extern void log_init(void);
 extern void log_finish(enum nh_log_status status);
 extern void log_truncate(void);
+extern void log_sync(void);
 extern long get_tz_offset(void);
 
 /* ### logreplay.c ### */
@@ -815,6 +820,7 @@ extern void replay_sync_save(void);
 extern char *replay_bones(int *buflen);
 extern void replay_setup_windowprocs(const struct nh_window_procs *procs);
 extern void replay_restore_windowprocs(void);
+extern boolean replay_read_option_snapshot(void);
 extern void replay_read_newgame(unsigned long long *init, int *playmode, char *namebuf,
 			int *initrole, int *initrace, int *initgend, int *initalign);
 extern boolean replay_run_cmdloop(boolean optonly, boolean singlestep, boolean fast);
@@ -860,6 +866,7 @@ extern int buzzmu(struct monst *, const struct attack *);
 /* ### memfile.c ### */
 
 extern void mnew(struct memfile *mf, struct memfile *relativeto);
+extern void mreset(struct memfile *mf, struct memfile *relativeto);
 extern void mfree(struct memfile *mf);
 extern void mwrite(struct memfile *mf, const void *buf, unsigned int num);
 extern void mwrite8(struct memfile *mf, int8_t value);
@@ -868,6 +875,9 @@ extern void mwrite32(struct memfile *mf, int32_t value);
 extern void mwrite64(struct memfile *mf, int64_t value);
 extern void store_mf(int fd, struct memfile *mf);
 extern void mtag(struct memfile *mf, long tagdata, enum memfile_tagtype tagtype);
+extern void msection_start(struct memfile *mf, int sect);
+extern void msection_end(struct memfile *mf, int sect);
+extern boolean mcopy_section(struct memfile *mf, int sect);
 extern void mdiffflush(struct memfile *mf);
 extern void mread(struct memfile *mf, void *, unsigned int);
 extern int8_t mread8(struct memfile *mf);
@@ -996,6 +1006,8 @@ extern void blessorcurse(struct obj *,int);
 extern boolean is_flammable(const struct obj *);
 extern boolean is_rottable(const struct obj *);
 extern void place_object(struct obj *otmp, struct level *lev, int x, int y);
+extern struct obj **floor_objects_in_box(struct level *lev, int lx, int ly,
+					 int hx, int hy, int *count);
 extern void remove_object(struct obj *);
 extern void discard_minvent(struct monst *);
 extern void obj_extract_self(struct obj *);
@@ -1049,6 +1061,12 @@ extern int mcalcmove(struct monst*);
 extern void mcalcdistress(void);
 extern void replmon(struct monst *,struct monst *);
 extern void relmon(struct monst *);
+extern void index_mid(struct monst *,int);
+extern void index_monchn(struct monst *,int);
+extern void unindex_mid(struct monst *);
+extern struct monst *lookup_mid(unsigned,int *);
+extern void clear_mid_index(void);
+extern void dealloc_monst(struct monst *);
 extern struct obj *mlifesaver(struct monst *);
 extern boolean corpse_chance(struct monst *,struct monst *,boolean);
 extern void mondead_helper(struct monst *,int);
@@ -1729,6 +1747,7 @@ extern void read_log_toptenentry(int fd, struct nh_topten_entry *entry);
 extern void initrack(void);
 extern void settrack(void);
 extern coord *gettrack(int,int);
+extern int get_track(coord *,int);
 extern void save_track(struct memfile *mf);
 extern void restore_track(struct memfile *mf);
 
@@ -1832,6 +1851,7 @@ extern void block_point(int,int);
 extern void unblock_point(int,int);
 extern boolean clear_path(int,int,int,int);
 extern void do_clear_area(int,int,int, void (*)(int,int,void *),void *);
+extern int wiz_vision_bench(void);
 
 /* ### weapon.c ### */
 
@@ -268,6 +268,11 @@ extern coord bhitpos;	/* place where throw or zap hits or stops */
 #define ENCBUFSZ	512	/* > ceil( BUFSZ/3) * 4 == 344 */
 #define EQBUFSZ		256	/* > ceil(QBUFSZ/3) * 4 == 172 */
 
+/* end of the option list that follows the binary data of a saved game;
+ * the number is the offset of the start of the list */
+#define OPTION_FOOTER_FMT	"\nNHOPTS %08lx\n"
+#define OPTION_FOOTER_LEN	17
+
 #ifndef max
 #define max(a,b) ((a) > (b) ? (a) : (b))
 #endif
@@ -35,6 +35,12 @@ typedef struct ls_t {
     short flags;
     short type;		/* type of light source */
     void * id;	/* source's identifier */
+
+    /* the squares lit last time, relative to (lit_x, lit_y); not saved */
+    unsigned long lit_epoch;	/* 0 if there's nothing cached */
+    xchar lit_x, lit_y;
+    short lit_range;
+    unsigned int lit_rows[2*MAX_RADIUS+1]; /* bit range+dx set if lit */
 } light_source;
 
 #endif /* LEV_H */
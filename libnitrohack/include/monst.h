@@ -157,8 +157,6 @@ struct monst {
  * exception being the guardian angels which are tame on creation).
  */
 
-#define dealloc_monst(mon) free((mon))
-
 /* these are in mspeed */
 #define MSLOW 1		/* slow monster */
 #define MFAST 2		/* speeded monster */
@@ -32,6 +32,7 @@ struct obj {
 	struct obj *cobj;	/* contents list for containers */
 	unsigned int o_id;
 	struct level *olev;	/* the level it is on */
+	unsigned long long floorseq; /* orders lev->objlist, see place_object() */
 	xchar ox,oy;
 	short otyp;		/* object class number */
 	unsigned owt;
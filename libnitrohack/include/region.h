@@ -50,6 +50,27 @@ struct region {
   int effect_id;		/* How to display if visible */
   int arg;		/* Optional user argument (Ex: strength of
 				   force field, damage of a fire zone, ...*/
+
+  unsigned char *insidemap;	/* which squares of the bounding box are in
+				   one of the rects; built on demand */
+};
+
+/*
+ * Per-level lookup tables for the regions on a level, so that a move that
+ * doesn't touch any region costs O(1) instead of a pass over every
+ * region's rectangles.  Not saved; rebuilt from the regions on demand.
+ */
+struct region_member {
+  unsigned int id;		/* m_id of a monster */
+  int count;			/* monsters[] entries for it; 0 = free slot */
+};
+
+struct region_index {
+  unsigned short cover[COLNO][ROWNO];	/* regions covering each square */
+  int n_hero_inside;		/* regions with REG_HERO_INSIDE set */
+  struct region_member *members;	/* hash of monsters in any region */
+  int members_size;		/* power of 2 */
+  int members_used;
 };
 
 #endif /* REGION_H */
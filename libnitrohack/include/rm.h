@@ -340,6 +340,9 @@ struct rm {
 	unsigned edge:1;	/* marks boundaries for special rooms*/
 };
 
+/* bytes per struct rm in a saved level; see save_locations() */
+#define LOCATION_SIZE	10
+
 #define SET_TYPLIT(lev, x, y, ttyp, llit)			\
 do {								\
 	if ((ttyp) < MAX_TYPE)					\
@@ -538,11 +541,12 @@ struct level {
     struct mon_gen_override *mon_gen;
     struct lvl_sounds	*sounds;
 
-    timer_element	*lev_timers;
+    struct timer_queue	lev_timers;
     struct ls_t		*lev_lights;
     struct trap 	*lev_traps;
     struct engr		*lev_engr;
     struct region 	**regions;
+    struct region_index	*regidx;	/* built on demand; see region.c */
 
     coord 		doors[DOORMAX];
     struct mkroom	rooms[(MAXNROFROOMS+1)*2];
@@ -564,12 +568,21 @@ struct level {
     int			max_regions;
 
     d_level		z;
+
+    /* Set when anything on the level may have changed since the level was
+     * last written to a diff memfile.  Clean levels are copied out of the
+     * previous command's save state instead of being serialized again, so
+     * code that changes a level other than the current one must call
+     * mark_level_dirty().  Not saved. */
+    boolean		dirty;
 };
 
 extern struct level *levels[MAXLINFO]; /* structure describing all levels */
 extern struct level *level;		/* pointer to an entry in levels */
 
 
+#define mark_level_dirty(lev)	((lev)->dirty = TRUE)
+
 #define OBJ_AT(x,y)	(level->objects[x][y] != NULL)
 #define OBJ_AT_LEV(lev, x,y)	((lev)->objects[x][y] != NULL)
 
@@ -30,13 +30,23 @@ typedef void (*timeout_proc)(void *, long);
 
 /* used in timeout.c */
 typedef struct timer_element {
-    struct timer_element *next;	/* next item in chain */
+    struct timer_element *hnext; /* next in (func_index, arg) hash chain */
     void *arg;			/* pointer to timeout argument */
+    unsigned long seq;		/* insertion order, breaks timeout ties */
     unsigned int timeout;	/* when we time out */
     unsigned int tid;		/* timer ID */
+    int hpos;			/* index in the heap */
     short kind;			/* kind of use */
     uchar func_index;		/* what to call when we time out */
     unsigned needs_fixup:1;	/* does arg need to be patched? */
 } timer_element;
 
+/* a level's timers: a heap ordered by timeout, hashed on (func_index, arg) */
+struct timer_queue {
+    timer_element **heap;
+    int count, size;
+    timer_element **hash;
+    int hsize;
+};
+
 #endif /* TIMEOUT_H */
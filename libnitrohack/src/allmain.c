@@ -61,6 +61,24 @@ void nh_lib_init(const struct nh_window_procs *procs, char **paths)
 }
 
 
+/*
+ * Load the game's data files ahead of time.  Meant for servers that fork game
+ * processes from a template process: call this once in the template.
+ */
+boolean nh_preload_data(void)
+{
+    boolean ok;
+    
+    if (!api_entry_checkpoint())
+	return FALSE;
+    
+    ok = dlb_preload();
+    
+    api_exit();
+    return ok;
+}
+
+
 void nh_lib_exit(void)
 {
     int i;
@@ -430,7 +448,8 @@ enum nh_restore_status nh_restore_game(int fd, struct nh_window_procs *rwinprocs
 
     if (!force_replay) {
 	error = ERR_RESTORE_FAILED;
-	replay_run_cmdloop(TRUE, FALSE, TRUE);
+	if (!replay_read_option_snapshot())
+	    replay_run_cmdloop(TRUE, FALSE, TRUE);
 	replay_jump_to_endpos();
 	if (!dorecover_fd(fd)) {
 	    replay_undo_jump_to_endpos();
@@ -1034,6 +1053,24 @@ int nh_command(const char *cmd, int rep, struct nh_cmd_arg *arg)
 }
 
 
+/* Fill in the fields of gi that nh_get_savegame_status() reads from the save
+ * of a game with the status LS_SAVED, but from the running game.  This lets a
+ * caller keep its own record of a game up to date without loading saves. */
+boolean nh_get_game_info(struct nh_game_info *gi)
+{
+    if (!program_state.game_running)
+	return FALSE;
+
+    gi->moves = moves;
+    gi->depth = depth(&u.uz);
+    gi->has_amulet = u.uhave.amulet;
+    gi->level_desc[0] = '\0';
+    topten_level_name(u.uz.dnum, depth(&u.uz), gi->level_desc);
+
+    return TRUE;
+}
+
+
 void stop_occupation(void)
 {
     if (occupation) {
@@ -165,6 +165,7 @@ const struct cmd_desc cmdlist[] = {
 	{"stats", "(DEBUG) show memory statistics", 0, 0, TRUE, wiz_show_stats, CMD_ARG_NONE | CMD_DEBUG | CMD_EXT | CMD_NOTIME},
 	{"timeout", "(DEBUG) look at timeout queue", 0, 0, TRUE, wiz_timeout_queue, CMD_ARG_NONE | CMD_DEBUG | CMD_EXT | CMD_NOTIME},
 	{"vision", "(DEBUG) show vision array", 0, 0, TRUE, wiz_show_vision, CMD_ARG_NONE | CMD_DEBUG | CMD_EXT | CMD_NOTIME},
+	{"visionbench", "(DEBUG) time the vision kernels along your recent path", 0, 0, TRUE, wiz_vision_bench, CMD_ARG_NONE | CMD_DEBUG | CMD_EXT | CMD_NOTIME},
 	{"wish", "(DEBUG) wish for an item", C('w'), 0, TRUE, wiz_wish, CMD_ARG_NONE | CMD_DEBUG},
 	{"wmode", "(DEBUG) show wall modes", 0, 0, TRUE, wiz_show_wmodes, CMD_ARG_NONE | CMD_DEBUG | CMD_EXT | CMD_NOTIME},
 	
@@ -281,6 +281,7 @@ void init_data(void)
     bhitpos.x = bhitpos.y = 0;
     preferred_pet = 0;
     migrating_mons = mydogs = NULL;
+    clear_mid_index();
     vision_full_recalc = FALSE;
     viz_array = NULL;
     artilist = NULL;
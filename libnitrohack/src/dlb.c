@@ -203,6 +203,7 @@ void close_library(library * lp)
     fclose(lp->fdata);
     free(lp->dir);
     free(lp->sspace);
+    free(lp->mem);
 
     memset((char *)lp, 0, sizeof(library));
 }
@@ -269,6 +270,13 @@ static int lib_dlb_fread(char *buf, int size, int quan, dlb *dp)
     if (quan == 0) return 0;
 
     pos = dp->start + dp->mark;
+    if (dp->lib->mem) {
+	/* preloaded: the library file is not touched at all */
+	memcpy(buf, dp->lib->mem + pos, size * quan);
+	dp->mark += size * quan;
+	return quan;
+    }
+
     if (dp->lib->fmark != pos) {
 	fseek(dp->lib->fdata, pos, SEEK_SET);	/* check for error??? */
 	dp->lib->fmark = pos;
@@ -366,6 +374,7 @@ const dlb_procs_t lib_dlb_procs = {
 
 static const dlb_procs_t *dlb_procs;
 static boolean dlb_initialized = FALSE;
+static boolean dlb_preloaded = FALSE;
 
 boolean dlb_init(void)
 {
@@ -378,8 +387,51 @@ boolean dlb_init(void)
     return dlb_initialized;
 }
 
+/*
+ * Read the libraries into memory and keep them there for the life of the
+ * process.  Processes forked afterwards share the data and don't need to
+ * read the files, or share their file offsets.
+ */
+boolean dlb_preload(void)
+{
+    int i;
+    long size;
+    library *lp;
+
+    if (!dlb_init())
+	return FALSE;
+
+    for (i = 0; i < MAX_LIBS && dlb_libs[i].fdata; i++) {
+	lp = &dlb_libs[i];
+	if (lp->mem)
+	    continue;
+
+	fseek(lp->fdata, 0L, SEEK_END);
+	size = ftell(lp->fdata);
+	fseek(lp->fdata, 0L, SEEK_SET);
+	lp->fmark = 0;
+	if (size <= 0)
+	    return FALSE;
+
+	lp->mem = malloc(size);
+	if (fread(lp->mem, 1, size, lp->fdata) != size) {
+	    free(lp->mem);
+	    lp->mem = NULL;
+	    fseek(lp->fdata, 0L, SEEK_SET);
+	    return FALSE;
+	}
+	fseek(lp->fdata, 0L, SEEK_SET);
+    }
+
+    dlb_preloaded = TRUE;
+    return TRUE;
+}
+
 void dlb_cleanup(void)
 {
+    if (dlb_preloaded)
+	return;	/* kept until the process exits */
+
     if (dlb_initialized) {
 	do_dlb_cleanup();
 	dlb_initialized = FALSE;
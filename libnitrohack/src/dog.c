@@ -245,6 +245,7 @@ void mon_arrive(struct monst *mtmp, boolean with_you)
 	mtmp->dlevel = level;
 	mtmp->nmon = level->monlist;
 	level->monlist = mtmp;
+	index_mid(mtmp, FM_FMON);
 	if (mtmp->isshk)
 	    set_residency(mtmp, FALSE);
 
@@ -557,6 +558,7 @@ void keepdogs(int exclude, const char *pet_msg_suffix)
 		mtmp->mlstmv = moves;
 		mtmp->nmon = mydogs;
 		mydogs = mtmp;
+		index_mid(mtmp, FM_MYDOGS);
 	    } else if (mtmp->iswiz) {
 		/* we want to be able to find him when his next resurrection
 		   chance comes up, but have him resume his present location
@@ -609,6 +611,7 @@ void migrate_to_level(
 	relmon(mtmp);
 	mtmp->nmon = migrating_mons;
 	migrating_mons = mtmp;
+	index_mid(mtmp, FM_MIGRATE);
 	newsym(mtmp->mx,mtmp->my);
 
 	new_lev.dnum = ledger_to_dnum((xchar)tolev);
@@ -388,6 +388,7 @@ void make_engr_at(struct level *lev, int x, int y,
 	memset(ep, 0, sizeof(struct engr) + engr_len + 1);
 	ep->nxt_engr = lev->lev_engr;
 	lev->lev_engr = ep;
+	mark_level_dirty(lev);
 	ep->engr_x = x;
 	ep->engr_y = y;
 	ep->engr_txt = (char *)(ep + 1);
@@ -1301,6 +1302,7 @@ void rest_engravings(struct memfile *mf, struct level *lev)
 
 void del_engr(struct level *lev, struct engr *ep)
 {
+	mark_level_dirty(lev);
 	if (ep == lev->lev_engr) {
 		lev->lev_engr = ep->nxt_engr;
 	} else {
@@ -323,11 +323,124 @@ void dgn_growths(struct level *lev, boolean showmsg, boolean update)
 		      Is_waterlevel(&lev->z) ? 200 : 25, showmsg, update);
 }
 
+/* Absences of up to this many growth steps are caught up one step at a time;
+ * longer ones are caught up in a single batched pass over the map. */
+#define GROWTH_CATCHUP_STEPS	500
+/* most growth events applied to any one square in a batched catch-up */
+#define GROWTH_CATCHUP_HITS	8
+/* rndmappos() chooses among this many squares */
+#define GROWTH_MAPPOS		((COLNO - 1) * ROWNO)
+
+/* fixed-point 1.0 for growth_hits() */
+#define HITS_ONE		((uint64_t)1 << 30)
+
+/*
+ * Number of times a particular square is chosen in n independent picks that
+ * each choose it with probability 1/denom, sampled from the binomial
+ * distribution but capped at cap.  Uses 2.30 fixed point so the result is the
+ * same on every platform.
+ */
+static int growth_hits(int n, unsigned int denom, int cap)
+{
+	uint64_t base = ((uint64_t)(denom - 1) << 30) / denom;
+	uint64_t prob = HITS_ONE, cum, u;
+	unsigned int e = n;
+	int k;
+
+	/* probability of no hits: (1 - 1/denom)^n */
+	while (e) {
+	    if (e & 1)
+		prob = (prob * base) >> 30;
+	    base = (base * base) >> 30;
+	    e >>= 1;
+	}
+
+	u = mt_random() >> 2;
+	cum = prob;
+	for (k = 0; k < cap && u >= cum && k < n; k++) {
+	    /* P(k+1) = P(k) * (n-k) / ((k+1) * (denom-1)) */
+	    prob = prob * (uint64_t)(n - k) / ((uint64_t)(k + 1) * (denom - 1));
+	    cum += prob;
+	}
+	return k;
+}
+
+/*
+ * Apply the effect of n calls to dgn_growths() in one pass over the map.
+ * Each call picks one random square for every kind of growth, so the number
+ * of times a square is picked is sampled directly and capped; beyond a few
+ * events per square the outcome is saturated anyway (herb piles are at their
+ * limit, trees have been looted, floating objects have drifted).  Trees that
+ * grow during the pass don't seed or drop fruit until the next one.
+ */
+static void batch_dgn_growths(struct level *lev, int n)
+{
+	static coord trees[COLNO * ROWNO], pools[COLNO * ROWNO];
+	int ntrees = 0, npools = 0;
+	unsigned waterforce = Is_waterlevel(&lev->z) ? 200 : 25;
+	int i, k, dd;
+	xchar x, y;
+
+	for (x = 1; x < COLNO; x++) {
+	    for (y = 0; y < ROWNO; y++) {
+		struct rm *loc = &lev->locations[x][y];
+		if (IS_TREE(lev, loc->typ) && may_dig(lev, x, y)) {
+		    trees[ntrees].x = x;
+		    trees[ntrees++].y = y;
+		} else if (IS_POOL(loc->typ) && lev->objects[x][y]) {
+		    pools[npools].x = x;
+		    pools[npools++].y = y;
+		}
+	    }
+	}
+
+	for (i = 0; i < ntrees; i++) {
+	    x = trees[i].x;
+	    y = trees[i].y;
+	    for (k = growth_hits(n, GROWTH_MAPPOS, GROWTH_CATCHUP_HITS); k > 0; k--)
+		seed_tree(lev, x, y);
+	    for (k = growth_hits(n, 30 * GROWTH_MAPPOS, GROWTH_CATCHUP_HITS);
+		 k > 0 && !(lev->locations[x][y].looted & TREE_LOOTED); k--)
+		drop_ripe_treefruit(lev, x, y, FALSE, FALSE);
+	}
+
+	/* herbs only grow where some already are, so only visit those squares;
+	 * spreading piles are found again by the squares scanned after them */
+	for (x = 1; x < COLNO; x++) {
+	    for (y = 0; y < ROWNO; y++) {
+		if (!lev->objects[x][y])
+		    continue;
+		for (dd = 0; dd < SIZE(herb_info); dd++) {
+		    if (!sobj_at(herb_info[dd].herb, lev, x, y))
+			continue;
+		    k = growth_hits(n, SIZE(herb_info) * GROWTH_MAPPOS,
+				    GROWTH_CATCHUP_HITS);
+		    for (; k > 0; k--) {
+			if (herb_info[dd].in_water)
+			    grow_water_herbs(herb_info[dd].herb, lev, x, y);
+			else
+			    grow_herbs(herb_info[dd].herb, lev, x, y, FALSE, FALSE);
+		    }
+		}
+	    }
+	}
+
+	for (i = 0; i < npools; i++) {
+	    for (k = growth_hits(n, GROWTH_MAPPOS, GROWTH_CATCHUP_HITS); k > 0; k--)
+		water_current(lev, pools[i].x, pools[i].y, rn2(8), waterforce,
+			      FALSE, FALSE);
+	}
+}
+
 /* catch up with growths when returning to a previously visited level */
 void catchup_dgn_growths(struct level *lev, int mvs)
 {
 	if (mvs < 0) mvs = 0;
 	else if (mvs > LARGEST_INT) mvs = LARGEST_INT;
+	if (mvs > GROWTH_CATCHUP_STEPS) {
+	    batch_dgn_growths(lev, mvs);
+	    return;
+	}
 	while (mvs-- > 0)
 	    dgn_growths(lev, FALSE, FALSE);
 }
@@ -1101,6 +1214,210 @@ static int autotravel_weighting(int x, int y, unsigned distance)
 	return distance * 10;
 }
 
+
+/* Monsters that just get in the way; travel walks around them. */
+static boolean travel_divert(const struct monst *mtmp)
+{
+	return mtmp &&
+	       /* can be seen or spotted */
+	       canspotmon(level, mtmp) &&
+	       mtmp->m_ap_type != M_AP_FURNITURE &&
+	       mtmp->m_ap_type != M_AP_OBJECT &&
+	       !(is_hider(mtmp->data) || mtmp->mundetected) &&
+	       /* peaceful monsters */
+	       ((mtmp->mpeaceful && !Hallucination) ||
+		/* monsters with no attacks */
+		noattacks(mtmp->data));
+}
+
+/*
+ * The flood fill that findtravelpath() does from a known target only depends
+ * on the hero's position for stopping when it gets there, so successive travel
+ * steps towards the same target can share one.  The field is kept between
+ * calls together with the state of the flood, which is resumed if the hero
+ * turns up somewhere it hasn't reached yet.  It is thrown away when anything
+ * the flood looks at changes: terrain, doors, boulders, seen traps, what the
+ * hero remembers or could see, monsters travel walks around, or the hero's
+ * own form and kit (see travel_field_key()).
+ */
+static struct travel_field {
+	struct level *lev;
+	uint64_t key;
+	boolean valid;
+	xchar tx, ty;
+	unsigned dist[COLNO][ROWNO];	/* the travel matrix; 0 = not reached */
+	xchar fromx[COLNO][ROWNO];	/* where each square was first reached */
+	xchar fromy[COLNO][ROWNO];	/* from, if dist is set */
+	xchar stepx[2][COLNO*ROWNO];
+	xchar stepy[2][COLNO*ROWNO];
+	/* flood state, so it can be resumed */
+	int n, nn, set, radius, i, dir;
+	boolean repeated;
+} tfield;
+
+static uint64_t travel_mix(uint64_t h, uint64_t v)
+{
+	h ^= v + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+	return h;
+}
+
+/* Position-independent hash of everything the travel flood reads. */
+static uint64_t travel_field_key(void)
+{
+	uint64_t h = 0, set = 0;
+	const struct trap *ttmp;
+	const struct obj *otmp;
+	int x, y;
+
+	for (x = 0; x < COLNO; x++) {
+	    for (y = 0; y < ROWNO; y++) {
+		const struct rm *loc = &level->locations[x][y];
+		h = travel_mix(h, loc->typ | (loc->flags << 8) |
+			       ((loc->seenv != 0) << 16) |
+			       ((!loc->seenv && !Blind && couldsee(x, y)) << 17) |
+			       (travel_divert(m_at(level, x, y)) << 18));
+	    }
+	}
+
+	/* order-independent, since these lists get reordered */
+	for (ttmp = level->lev_traps; ttmp; ttmp = ttmp->ntrap)
+	    if (ttmp->tseen)
+		set += travel_mix(1, ttmp->tx | (ttmp->ty << 8));
+	for (otmp = level->objlist; otmp; otmp = otmp->nobj)
+	    if (otmp->otyp == BOULDER)
+		set += travel_mix(2, otmp->ox | (otmp->oy << 8));
+	h = travel_mix(h, set);
+
+	otmp = carrying(WAN_DIGGING);
+	h = travel_mix(h, u.umonnum);
+	h = travel_mix(h, (!!Passes_walls) | (!!can_ooze(&youmonst) << 1) |
+		       (!!Levitation << 2) | (!!Flying << 3) |
+		       (!!Blind << 4) | (!!Hallucination << 5) |
+		       (!!flags.autodig << 6) | (!!flags.nopick << 7) |
+		       ((uwep && is_pick(uwep)) << 8) |
+		       ((invent && inv_weight() + weight_cap() > 600) << 9) |
+		       (!!carrying(PICK_AXE) << 10) |
+		       (!!carrying(DWARVISH_MATTOCK) << 11) |
+		       ((otmp && !objects[otmp->otyp].oc_name_known) << 12) |
+		       (flags.run << 16));
+	return h;
+}
+
+/*
+ * The flood's result depends on where the hero is if they stand where
+ * test_move() treats them specially (a seen trap or water they'd otherwise
+ * avoid) or where a shopkeeper might block the way.  Don't use the shared
+ * field then.
+ */
+static boolean travel_field_usable(void)
+{
+	const struct rm *loc = &level->locations[u.ux][u.uy];
+	const struct trap *t = t_at(level, u.ux, u.uy);
+
+	if (*u.ushops || IS_DOOR(loc->typ))
+	    return FALSE;
+	if (t && t->tseen)
+	    return FALSE;
+	if (!Levitation && !Flying && !is_clinger(youmonst.data) &&
+	    (is_pool(level, u.ux, u.uy) || is_lava(level, u.ux, u.uy) ||
+	     is_swamp(level, u.ux, u.uy)) && loc->seenv)
+	    return FALSE;
+	return TRUE;
+}
+
+static void reset_travel_field(xchar tx, xchar ty, uint64_t key)
+{
+	struct travel_field *tf = &tfield;
+
+	tf->lev = level;
+	tf->key = key;
+	tf->valid = TRUE;
+	tf->tx = tx;
+	tf->ty = ty;
+	memset(tf->dist, 0, sizeof(tf->dist));
+	tf->stepx[0][0] = tx;
+	tf->stepy[0][0] = ty;
+	tf->n = 1;
+	tf->nn = 0;
+	tf->set = 0;
+	tf->radius = 1;
+	tf->i = 0;
+	tf->dir = 0;
+	tf->repeated = FALSE;
+}
+
+/*
+ * Continue the flood from the field's target until (ux,uy) is reached.
+ * Squares are visited in exactly the order findtravelpath() would visit them
+ * when flooding from scratch.
+ */
+static boolean flood_travel_field(xchar ux, xchar uy)
+{
+	struct travel_field *tf = &tfield;
+	static const int ordered[] = { 0, 2, 4, 6, 1, 3, 5, 7 };
+	/* no diagonal movement for grid bugs */
+	int dirmax = u.umonnum == PM_GRID_BUG ? 4 : 8;
+
+	if (tf->dist[ux][uy])
+	    return TRUE;
+
+	while (tf->n != 0) {
+	    for (; tf->i < tf->n; tf->i++, tf->dir = 0, tf->repeated = FALSE) {
+		int x = tf->stepx[tf->set][tf->i];
+		int y = tf->stepy[tf->set][tf->i];
+
+		for (; tf->dir < dirmax; tf->dir++) {
+		    int nx = x + xdir[ordered[tf->dir]];
+		    int ny = y + ydir[ordered[tf->dir]];
+
+		    if (!isok(nx, ny))
+			continue;
+
+		    if ((!Passes_walls && !can_ooze(&youmonst) &&
+			 closed_door(level, nx, ny)) ||
+			sobj_at(BOULDER, level, nx, ny) ||
+			travel_divert(m_at(level, nx, ny)) ||
+			test_move(x, y, nx-x, ny-y, 0, TEST_TRAP)) {
+			if ((int)tf->dist[x][y] > tf->radius - 5) {
+			    if (!tf->repeated) {
+				tf->stepx[1-tf->set][tf->nn] = x;
+				tf->stepy[1-tf->set][tf->nn] = y;
+				tf->nn++;
+				tf->repeated = TRUE;
+			    }
+			    continue;
+			}
+		    }
+		    if ((test_move(x, y, nx-x, ny-y, 0, TEST_TRAP) ||
+			 test_move(x, y, nx-x, ny-y, 0, TEST_TRAV)) &&
+			(level->locations[nx][ny].seenv ||
+			 (!Blind && couldsee(nx, ny))) &&
+			!tf->dist[nx][ny]) {
+			tf->stepx[1-tf->set][tf->nn] = nx;
+			tf->stepy[1-tf->set][tf->nn] = ny;
+			tf->nn++;
+			tf->dist[nx][ny] = tf->radius;
+			tf->fromx[nx][ny] = x;
+			tf->fromy[nx][ny] = y;
+			if (nx == ux && ny == uy) {
+			    tf->dir++;
+			    return TRUE;
+			}
+		    }
+		}
+	    }
+
+	    tf->n = tf->nn;
+	    tf->nn = 0;
+	    tf->set = 1 - tf->set;
+	    tf->radius++;
+	    tf->i = 0;
+	    tf->dir = 0;
+	    tf->repeated = FALSE;
+	}
+	return FALSE;
+}
+
 /*
  * Find a path from the destination (u.tx,u.ty) back to (u.ux,u.uy).
  * A shortest path is returned.  If guess is non-NULL, instead travel
@@ -1143,6 +1460,27 @@ static boolean findtravelpath(boolean (*guess)(int, int), schar *dx, schar *dy)
 	}
 
     noguess:
+	if (!guess && travel_field_usable()) {
+	    uint64_t key = travel_field_key();
+	    struct travel_field *tf = &tfield;
+
+	    if (!tf->valid || tf->lev != level || tf->key != key ||
+		tf->tx != tx || tf->ty != ty)
+		reset_travel_field(tx, ty, key);
+	    if (!flood_travel_field(ux, uy))
+		return FALSE;
+
+	    *dx = tf->fromx[ux][uy] - ux;
+	    *dy = tf->fromy[ux][uy] - uy;
+	    if (tf->fromx[ux][uy] == u.tx && tf->fromy[ux][uy] == u.ty) {
+		nomul(0, NULL);
+		/* reset run so domove run checks work */
+		flags.run = 8;
+		iflags.travelcc.x = iflags.travelcc.y = -1;
+	    }
+	    return TRUE;
+	}
+
 	memset(travel, 0, sizeof(travel));
 	travelstepx[0][0] = tx;
 	travelstepy[0][0] = ty;
@@ -1160,7 +1498,6 @@ static boolean findtravelpath(boolean (*guess)(int, int), schar *dx, schar *dy)
 		boolean alreadyrepeated = FALSE;
 
 		for (dir = 0; dir < dirmax; ++dir) {
-		    const struct monst *mtmp;
 		    boolean divert_mon;
 		    int nx = x+xdir[ordered[dir]];
 		    int ny = y+ydir[ordered[dir]];
@@ -1204,17 +1541,7 @@ static boolean findtravelpath(boolean (*guess)(int, int), schar *dx, schar *dy)
 			continue;
 
 		    /* Walk around monsters that just get in the way. */
-		    mtmp = m_at(level, nx, ny);
-		    divert_mon = (mtmp &&
-				  /* can be seen or spotted */
-				  canspotmon(level, mtmp) &&
-				  mtmp->m_ap_type != M_AP_FURNITURE &&
-				  mtmp->m_ap_type != M_AP_OBJECT &&
-				  !(is_hider(mtmp->data) || mtmp->mundetected) &&
-				  /* peaceful monsters */
-				  ((mtmp->mpeaceful && !Hallucination) ||
-				   /* monsters with no attacks */
-				   noattacks(mtmp->data)));
+		    divert_mon = travel_divert(m_at(level, nx, ny));
 
 		    if ((!Passes_walls && !can_ooze(&youmonst) &&
 			 closed_door(level, nx, ny)) ||
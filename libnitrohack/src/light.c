@@ -24,12 +24,13 @@
  * The major working function is do_light_sources(). It is called
  * when the vision system is recreating its "could see" array.  Here
  * we add a flag (TEMP_LIT) to the array for all locations that are lit
- * via a light source.  The bad part of this is that we have to
- * re-calculate the LOS of each light source every time the vision
- * system runs.  Even if the light sources and any topology (vision blocking
- * positions) have not changed.  The good part is that no extra memory
- * is used, plus we don't have to figure out how far the sources have moved,
- * or if the topology has changed.
+ * via a light source.  Each source remembers which squares it lit, and
+ * only re-calculates their LOS if it has moved, its range has changed,
+ * or the topology (vision blocking positions) within its range has
+ * changed: block_point() and unblock_point() report that through
+ * light_sources_topology_changed(), and vision_reset() discards every
+ * remembered circle via flush_light_cache().  Sources at the hero are
+ * not remembered; they use the vision system's own could see bits.
  *
  * The structure of the save/restore mechanism is amazingly similar to
  * the timer save/restore.  This is because they both have the same
@@ -42,6 +43,7 @@
 #define LSF_NEEDS_FIXUP	0x2		/* need oid fixup */
 
 static void insert_light_source(struct level *lev, light_source *ls);
+static void calc_lit_squares(light_source *ls);
 static light_source *remove_light_source(light_source **light_chain, light_source *ls);
 static void write_ls(struct memfile *mf, light_source *);
 static int maybe_write_ls(struct memfile *mf, struct level *lev, int range, boolean write_it);
@@ -50,11 +52,15 @@ static int maybe_write_ls(struct memfile *mf, struct level *lev, int range, bool
 extern const char circle_data[];
 extern const char circle_start[];
 
+/* bumped whenever all remembered light circles become invalid */
+static unsigned long light_epoch = 1;
+
 
 static void insert_light_source(struct level *lev, light_source *ls)
 {
     ls->next = lev->lev_lights;
     lev->lev_lights = ls;
+    mark_level_dirty(lev);
 }
 
 
@@ -99,7 +105,9 @@ void new_light_source(struct level *lev, xchar x, xchar y, int range, int type,
     ls->type = type;
     ls->id = id;
     ls->flags = 0;
+    ls->lit_epoch = 0;
     lev->lev_lights = ls;
+    mark_level_dirty(lev);
 
     vision_full_recalc = 1;	/* make the source show up */
 }
@@ -132,6 +140,7 @@ void del_light_source(struct level *lev, int type, void *id)
 		prev->next = curr->next;
 	    else
 		lev->lev_lights = curr->next;
+	    mark_level_dirty(lev);
 
 	    free(curr);
 	    vision_full_recalc = 1;
@@ -140,6 +149,42 @@ void del_light_source(struct level *lev, int type, void *id)
     }
 }
 
+/*
+ * Work out which squares in the circle of ls are visible from its center
+ * and remember them in ls->lit_rows.
+ *
+ * Kevin's tests indicated that doing this brute-force method is faster for
+ * radius <= 3 (or so).
+ */
+static void calc_lit_squares(light_source *ls)
+{
+    int x, y, min_x, max_x, min_y, max_y, offset;
+    const char *limits;
+    unsigned int bits;
+
+    memset(ls->lit_rows, 0, sizeof(ls->lit_rows));
+    limits = circle_ptr(ls->range);
+    if ((max_y = (ls->y + ls->range)) >= ROWNO) max_y = ROWNO-1;
+    if ((min_y = (ls->y - ls->range)) < 0) min_y = 0;
+    for (y = min_y; y <= max_y; y++) {
+	offset = limits[abs(y - ls->y)];
+	if ((min_x = (ls->x - offset)) < 0) min_x = 0;
+	if ((max_x = (ls->x + offset)) >= COLNO) max_x = COLNO-1;
+
+	bits = 0;
+	for (x = min_x; x <= max_x; x++)
+	    if ((ls->x == x && ls->y == y)
+		    || clear_path((int)ls->x, (int) ls->y, x, y))
+		bits |= 1U << (x - ls->x + ls->range);
+	ls->lit_rows[y - ls->y + ls->range] = bits;
+    }
+
+    ls->lit_x = ls->x;
+    ls->lit_y = ls->y;
+    ls->lit_range = ls->range;
+    ls->lit_epoch = light_epoch;
+}
+
 /* Mark locations that are temporarily lit via mobile light sources. */
 void do_light_sources(char **cs_rows)
 {
@@ -148,16 +193,12 @@ void do_light_sources(char **cs_rows)
     short at_hero_range = 0;
     light_source *ls;
     char *row;
+    unsigned int bits;
 
     for (ls = level->lev_lights; ls; ls = ls->next) {
 	ls->flags &= ~LSF_SHOW;
 
-	/*
-	 * Check for moved light sources.  It may be possible to
-	 * save some effort if an object has not moved, but not in
-	 * the current setup -- we need to recalculate for every
-	 * vision recalc.
-	 */
+	/* Check for moved light sources. */
 	if (ls->type == LS_OBJECT) {
 	    if (get_obj_location((struct obj *) ls->id, &ls->x, &ls->y, 0))
 		ls->flags |= LSF_SHOW;
@@ -175,13 +216,20 @@ void do_light_sources(char **cs_rows)
 		at_hero_range = ls->range;
 	}
 
-	if (ls->flags & LSF_SHOW) {
+	if (!(ls->flags & LSF_SHOW))
+	    continue;
+
+	if (ls->x == u.ux && ls->y == u.uy) {
 	    /*
-	     * Walk the points in the circle and see if they are
-	     * visible from the center.  If so, mark'em.
-	     *
-	     * Kevin's tests indicated that doing this brute-force
-	     * method is faster for radius <= 3 (or so).
+	     * If the light source is located at the hero, then
+	     * we can use the COULD_SEE bits already calcualted
+	     * by the vision system.  More importantly than
+	     * this optimization, is that it allows the vision
+	     * system to correct problems with clear_path().
+	     * The function clear_path() is a simple LOS
+	     * path checker that doesn't go out of its way
+	     * make things look "correct".  The vision system
+	     * does this.
 	     */
 	    limits = circle_ptr(ls->range);
 	    if ((max_y = (ls->y + ls->range)) >= ROWNO) max_y = ROWNO-1;
@@ -191,52 +239,67 @@ void do_light_sources(char **cs_rows)
 		offset = limits[abs(y - ls->y)];
 		if ((min_x = (ls->x - offset)) < 0) min_x = 0;
 		if ((max_x = (ls->x + offset)) >= COLNO) max_x = COLNO-1;
+		for (x = min_x; x <= max_x; x++)
+		    if (row[x] & COULD_SEE)
+			row[x] |= TEMP_LIT;
+	    }
+	} else {
+	    if (ls->lit_epoch != light_epoch || ls->lit_x != ls->x ||
+		ls->lit_y != ls->y || ls->lit_range != ls->range)
+		calc_lit_squares(ls);
 
-		if (ls->x == u.ux && ls->y == u.uy) {
-		    /*
-		     * If the light source is located at the hero, then
-		     * we can use the COULD_SEE bits already calcualted
-		     * by the vision system.  More importantly than
-		     * this optimization, is that it allows the vision
-		     * system to correct problems with clear_path().
-		     * The function clear_path() is a simple LOS
-		     * path checker that doesn't go out of its way
-		     * make things look "correct".  The vision system
-		     * does this.
-		     */
-		    for (x = min_x; x <= max_x; x++)
-			if (row[x] & COULD_SEE)
-			    row[x] |= TEMP_LIT;
-		} else {
-		    for (x = min_x; x <= max_x; x++)
-			if ((ls->x == x && ls->y == y)
-				|| clear_path((int)ls->x, (int) ls->y, x, y))
-			    row[x] |= TEMP_LIT;
-		}
+	    if ((max_y = (ls->y + ls->range)) >= ROWNO) max_y = ROWNO-1;
+	    if ((y = (ls->y - ls->range)) < 0) y = 0;
+	    for (; y <= max_y; y++) {
+		row = cs_rows[y];
+		bits = ls->lit_rows[y - ls->y + ls->range];
+		for (x = ls->x - ls->range; bits; x++, bits >>= 1)
+		    if (bits & 1)
+			row[x] |= TEMP_LIT;
 	    }
 	}
     }
 }
 
+/*
+ * The location (x,y) has started or stopped blocking light.  Forget the
+ * circles of the light sources it could be in.
+ */
+void light_sources_topology_changed(int x, int y)
+{
+    light_source *ls;
+
+    if (!level)
+	return;
+    for (ls = level->lev_lights; ls; ls = ls->next)
+	if (ls->lit_epoch && abs(x - ls->lit_x) <= ls->lit_range &&
+	    abs(y - ls->lit_y) <= ls->lit_range)
+	    ls->lit_epoch = 0;
+}
+
+/* Forget the circles of all light sources, e.g. for a new level. */
+void flush_light_cache(void)
+{
+    light_epoch++;
+}
+
+
 /* (mon->mx == 0) implies migrating */
 #define mon_is_local(mon)	((mon)->mx > 0)
 
 struct monst *find_mid(struct level *lev, unsigned nid, unsigned fmflags)
 {
 	struct monst *mtmp;
+	int chain;
 
 	if (!nid)
 	    return &youmonst;
-	if (fmflags & FM_FMON)
-		for (mtmp = lev->monlist; mtmp; mtmp = mtmp->nmon)
-		    if (!DEADMONSTER(mtmp) && mtmp->m_id == nid) return mtmp;
-	if (fmflags & FM_MIGRATE)
-		for (mtmp = migrating_mons; mtmp; mtmp = mtmp->nmon)
-	    	    if (mtmp->m_id == nid) return mtmp;
-	if (fmflags & FM_MYDOGS)
-		for (mtmp = mydogs; mtmp; mtmp = mtmp->nmon)
-	    	    if (mtmp->m_id == nid) return mtmp;
-	return NULL;
+	mtmp = lookup_mid(nid, &chain);
+	if (!mtmp || !(chain & fmflags))
+	    return NULL;
+	if (chain == FM_FMON && (mtmp->dlevel != lev || DEADMONSTER(mtmp)))
+	    return NULL;
+	return mtmp;
 }
 
 
@@ -271,6 +334,8 @@ void transfer_lights(struct level *oldlev, struct level *newlev, unsigned int ob
 	    *prev = curr->next;
 	    curr->next = newlev->lev_lights;
 	    newlev->lev_lights = curr;
+	    mark_level_dirty(oldlev);
+	    mark_level_dirty(newlev);
 	} else {
 	    prev = &(*prev)->next;
 	}
@@ -328,6 +393,7 @@ void restore_light_sources(struct memfile *mf, struct level *lev)
 	ls->id = (void*)id;
 	ls->x = mread8(mf);
 	ls->y = mread8(mf);
+	ls->lit_epoch = 0;
 	
 	ls->next = lev->lev_lights;
 	lev->lev_lights = ls;
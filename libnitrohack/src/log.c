@@ -5,6 +5,10 @@
 #include "patchlevel.h"
 #include <zlib.h>
 
+#ifdef LOG_WRITER_THREAD
+# include <pthread.h>
+#endif
+
 /* #define DEBUG */
 
 extern const struct cmd_desc cmdlist[];
@@ -16,6 +20,14 @@ static struct memfile recent_cmd_states[2];
 static struct memfile *last_cmd_state = recent_cmd_states;
 static const char *const statuscodes[] = {"save", "done", "inpr"};
 static int last_curline;
+static int log_compression = Z_BEST_COMPRESSION;
+
+/* The header is rewritten after every header_interval commands, and at
+ * least every HEADER_MAX_AGE seconds while commands are being logged. */
+#define HEADER_MAX_AGE 10
+static int header_interval = 1;
+static unsigned int header_action_count;
+static time_t header_time;
 
 static const unsigned char b64e[64] =
     "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
@@ -29,14 +41,17 @@ static int base64size(int n)
 }
 
 
-static void base64_encode_binary(const unsigned char* in, char *out, int len)
+static boolean base64_encode_binary(const unsigned char* in, char *out, int len,
+				    int level)
 {
     int i, pos, rem;
     unsigned long olen = compressBound(len);
     unsigned char *o = malloc(olen);
 
-    if (compress2(o, &olen, in, len, Z_BEST_COMPRESSION) != Z_OK)
-	panic("Could not compress input data!");
+    if (compress2(o, &olen, in, len, level) != Z_OK) {
+	free(o);
+	return FALSE;
+    }
 
     pos = sprintf(out, "$%d$", len);
     if (pos + olen >= len) {
@@ -69,12 +84,265 @@ static void base64_encode_binary(const unsigned char* in, char *out, int len)
     free(o);
 
     out[pos] = '\0';
+    return TRUE;
 }
 
 
 static void base64_encode(const char* in, char *out)
 {
-    base64_encode_binary((const unsigned char*)in, out, strlen(in));
+    if (!base64_encode_binary((const unsigned char*)in, out, strlen(in),
+			      log_compression))
+	panic("Could not compress input data!");
+}
+
+
+/*
+ * The background log writer.
+ *
+ * Compressing and encoding the save diff after each command is the most
+ * expensive part of logging, so when threads are available that work is
+ * handed to a writer thread.  The game thread queues jobs; the writer runs
+ * them strictly in order.  Plain text written while jobs are outstanding is
+ * collected in a pending buffer and queued behind them, so the file contents
+ * are exactly the same as when everything is written directly.
+ *
+ * Anything that needs the file itself (truncation, the final header update,
+ * reading the log back) must call log_sync() first.  Errors in the writer are
+ * reported by the next log_sync(), since only the game thread may panic.
+ */
+#ifdef LOG_WRITER_THREAD
+
+#define LOG_QUEUE_MAX (16 * 1024 * 1024) /* queued bytes before we wait */
+
+enum log_job_type {
+    LJ_TEXT,	/* write data */
+    LJ_BINARY,	/* compress and encode data, write with prefix */
+    LJ_MARK,	/* update last_cmd_pos */
+    LJ_HEADER,	/* update last_cmd_pos and rewrite the header */
+};
+
+struct log_job {
+    struct log_job *next;
+    enum log_job_type type;
+    int fd;
+    char prefix[3];
+    char *data;
+    int len;
+    unsigned int action_count;
+};
+
+static boolean log_async = TRUE;
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t work;	/* signalled when a job is queued */
+    pthread_cond_t done;	/* signalled when a job is finished */
+    boolean started;
+    struct log_job *head, *tail;
+    long queued;		/* bytes of data in the queue */
+    char *pending;		/* text not yet queued */
+    int pendinglen, pendingsize;
+    char error[BUFSZ];		/* first failure in the writer, if any */
+} lw = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER,
+	 PTHREAD_COND_INITIALIZER };
+
+
+static boolean write_header(int fd, unsigned int count, boolean rewrite);
+
+static void log_writer_run(struct log_job *job)
+{
+    char *b64buf;
+
+    switch (job->type) {
+    case LJ_TEXT:
+	if (!write_full(job->fd, job->data, job->len))
+	    snprintf(lw.error, BUFSZ, "writing %d bytes to the log failed.",
+		     job->len);
+	break;
+
+    case LJ_BINARY:
+	b64buf = malloc(base64size(job->len));
+	if (!base64_encode_binary((const unsigned char*)job->data, b64buf,
+				  job->len, log_compression))
+	    snprintf(lw.error, BUFSZ, "Could not compress input data!");
+	else if (!write_full(job->fd, job->prefix, 3) ||
+		 !write_full(job->fd, b64buf, strlen(b64buf)))
+	    snprintf(lw.error, BUFSZ, "log_binary: writing to log failed.");
+	free(b64buf);
+	break;
+
+    case LJ_MARK:
+    case LJ_HEADER:
+	if (!write_header(job->fd, job->action_count, job->type == LJ_HEADER))
+	    snprintf(lw.error, BUFSZ, "updating the log header failed.");
+	break;
+    }
+}
+
+
+static void *log_writer_main(void *unused)
+{
+    struct log_job *job;
+
+    pthread_mutex_lock(&lw.lock);
+    while (TRUE) {
+	while (!lw.head)
+	    pthread_cond_wait(&lw.work, &lw.lock);
+
+	/* the job stays queued while it runs, so that log_sync() waits for it */
+	job = lw.head;
+	pthread_mutex_unlock(&lw.lock);
+	if (!lw.error[0])
+	    log_writer_run(job);
+	pthread_mutex_lock(&lw.lock);
+
+	lw.head = job->next;
+	if (!lw.head)
+	    lw.tail = NULL;
+	lw.queued -= job->len;
+	free(job->data);
+	free(job);
+	pthread_cond_broadcast(&lw.done);
+    }
+
+    return NULL;
+}
+
+
+/* Queue a job; takes ownership of data.  Call with lw.lock held. */
+static void log_queue_job(enum log_job_type type, char *data, int len,
+			  const char *prefix)
+{
+    struct log_job *job = malloc(sizeof(struct log_job));
+
+    job->next = NULL;
+    job->type = type;
+    job->fd = logfile;
+    if (prefix)
+	memcpy(job->prefix, prefix, 3);
+    job->data = data;
+    job->len = len;
+    job->action_count = action_count;
+
+    if (lw.tail)
+	lw.tail->next = job;
+    else
+	lw.head = job;
+    lw.tail = job;
+    lw.queued += len;
+    pthread_cond_signal(&lw.work);
+}
+
+
+/* Move the pending text into the queue.  Call with lw.lock held. */
+static void log_queue_pending(void)
+{
+    if (!lw.pendinglen)
+	return;
+    log_queue_job(LJ_TEXT, lw.pending, lw.pendinglen, NULL);
+    lw.pending = NULL;
+    lw.pendinglen = lw.pendingsize = 0;
+}
+
+
+/*
+ * Start queueing a job of the given type.  Returns FALSE if the job should
+ * be done directly instead.  On success, lw.lock is held and any pending
+ * text has been queued ahead of the new job.
+ */
+static boolean log_queue_begin(void)
+{
+    pthread_t thread;
+
+    if (!log_async)
+	return FALSE;
+
+    pthread_mutex_lock(&lw.lock);
+    if (!lw.started) {
+	/* started lazily, so that processes which never log don't get one */
+	if (pthread_create(&thread, NULL, log_writer_main, NULL) != 0) {
+	    pthread_mutex_unlock(&lw.lock);
+	    log_async = FALSE;
+	    return FALSE;
+	}
+	pthread_detach(thread);
+	lw.started = TRUE;
+    }
+
+    /* don't let the game run arbitrarily far ahead of the disk */
+    while (lw.queued > LOG_QUEUE_MAX)
+	pthread_cond_wait(&lw.done, &lw.lock);
+
+    log_queue_pending();
+    return TRUE;
+}
+
+
+/*
+ * Text goes straight to the file if the writer has nothing outstanding,
+ * otherwise it must wait its turn.  Returns TRUE if buf was queued.
+ */
+static boolean log_queue_text(const char *buf, int len)
+{
+    if (!lw.started)
+	return FALSE;
+
+    pthread_mutex_lock(&lw.lock);
+    if (!lw.head && !lw.pendinglen) {
+	pthread_mutex_unlock(&lw.lock);
+	return FALSE;
+    }
+
+    if (lw.pendinglen + len > lw.pendingsize) {
+	lw.pendingsize = max(lw.pendingsize * 2, lw.pendinglen + len + 4096);
+	lw.pending = realloc(lw.pending, lw.pendingsize);
+    }
+    memcpy(lw.pending + lw.pendinglen, buf, len);
+    lw.pendinglen += len;
+    pthread_mutex_unlock(&lw.lock);
+    return TRUE;
+}
+
+
+/* Wait until everything queued has been written. */
+void log_sync(void)
+{
+    char errbuf[BUFSZ];
+
+    if (!lw.started)
+	return;
+
+    pthread_mutex_lock(&lw.lock);
+    log_queue_pending();
+    while (lw.head)
+	pthread_cond_wait(&lw.done, &lw.lock);
+    strcpy(errbuf, lw.error);
+    lw.error[0] = '\0';
+    pthread_mutex_unlock(&lw.lock);
+
+    if (errbuf[0]) {
+	log_async = FALSE; /* don't make it worse */
+	panic("%s", errbuf);
+    }
+}
+
+#else /* !LOG_WRITER_THREAD */
+
+void log_sync(void)
+{
+}
+
+#endif /* LOG_WRITER_THREAD */
+
+
+/* Write to the log in order with everything else written to it. */
+static void log_write(const char *buf, int len)
+{
+#ifdef LOG_WRITER_THREAD
+    if (log_queue_text(buf, len))
+	return;
+#endif
+    if (!write_full(logfile, buf, len))
+	panic("writing %d bytes to the log failed.", len);
 }
 
 
@@ -88,72 +356,178 @@ static int lprintf(const char *fmt, ...)
     size = vsnprintf(outbuf, sizeof(outbuf), fmt, vargs);
     va_end(vargs);
 
-    if (write(logfile, outbuf, size) != size)
-	panic("writing %d bytes to the log failed.", size);
-
+    log_write(outbuf, size);
     return size;
 }
 
 
-void log_option(struct nh_option_desc *opt)
+/*
+ * Note the end of the last complete command, and if rewrite is set, record it
+ * in the header, which is also where replay stops reading.  fd's file
+ * position is preserved.
+ */
+static boolean write_header(int fd, unsigned int count, boolean rewrite)
 {
-    char encbuf[ENCBUFSZ];
-    char *str, *encbuf2;
-    
-    if (iflags.disable_log || logfile == -1)
+    char header[32];
+    int len;
+    boolean ok;
+
+    last_cmd_pos = lseek(fd, 0, SEEK_CUR);
+    if (!rewrite)
+	return TRUE;
+    len = snprintf(header, sizeof(header), "NHGAME %4s %08x %08x",
+		   statuscodes[LS_IN_PROGRESS], last_cmd_pos, count);
+    lseek(fd, 0, SEEK_SET);
+    ok = write_full(fd, header, len);
+    lseek(fd, last_cmd_pos, SEEK_SET);
+    return ok;
+}
+
+
+/*
+ * Let the UI (or server) choose how game logs are written: the zlib level for
+ * saved diffs (out-of-range values leave it alone), whether compression and
+ * writing are done in the background when that is supported, and how many
+ * commands may pass between updates of the log header (0 leaves it alone).
+ */
+void nh_configure_log(int compression_level, boolean async_write,
+		      int header_every)
+{
+    if (!api_entry_checkpoint())
 	return;
+
+    if (compression_level >= Z_NO_COMPRESSION &&
+	compression_level <= Z_BEST_COMPRESSION)
+	log_compression = compression_level;
+    if (header_every > 0)
+	header_interval = header_every;
+#ifdef LOG_WRITER_THREAD
+    if (!async_write)
+	log_sync();
+    log_async = async_write;
+#endif
+
+    api_exit();
+}
+
+
+/*
+ * Encode an option the way it is recorded in the log: "!name:type:value".
+ * replay_read_option() reads it back.  Returns a malloc'd string.
+ */
+char *log_encode_option(struct nh_option_desc *opt)
+{
+    char encbuf[ENCBUFSZ], valbuf[ENCBUFSZ];
+    char *str, *val = valbuf, *out;
+    char type = '\0';
     
     base64_encode(opt->name, encbuf);
-    lprintf("\n!%s:", encbuf);
+    valbuf[0] = '\0';
     
     switch (opt->type) {
 	case OPTTYPE_STRING:
+	    type = 's';
 	    str = opt->value.s ? opt->value.s : "";
-	    base64_encode(str, encbuf);
-	    lprintf("s:%s", encbuf);
+	    base64_encode(str, valbuf);
 	    break;
 	    
 	case OPTTYPE_ENUM:
-	    lprintf("e:%x", opt->value.e);
+	    type = 'e';
+	    sprintf(valbuf, "%x", opt->value.e);
 	    break;
 	    
 	case OPTTYPE_INT:
-	    lprintf("i:%d", opt->value.i);
+	    type = 'i';
+	    sprintf(valbuf, "%d", opt->value.i);
 	    break;
 	    
 	case OPTTYPE_BOOL:
-	    lprintf("b:%x", !!opt->value.b);
+	    type = 'b';
+	    sprintf(valbuf, "%x", !!opt->value.b);
 	    break;
 	
 	case OPTTYPE_AUTOPICKUP_RULES:
-	    str = autopickup_to_string(opt->value.ar);
-	    lprintf("a:");
-	    encbuf2 = malloc(base64size(strlen(str)));
-	    base64_encode(str, encbuf2);
-	    /* write directly, large numbers of rules might overflow outbuf in lprintf */
-	    if (!write_full(logfile, encbuf2, strlen(encbuf2)))
-		panic("log_option: failed to write autopickup_rules");
-	    free(encbuf2);
-	    free(str);
-	    break;
-	    
 	case OPTTYPE_MSGTYPE:
-	    str = msgtype_to_string(opt->value.mt);
-	    lprintf("m:");
-	    encbuf2 = malloc(base64size(strlen(str)));
-	    base64_encode(str, encbuf2);
-	    /* write directly, large numbers of rules may overflow outbuf in lprintf */
-	    if (!write_full(logfile, encbuf2, strlen(encbuf2)))
-		panic("log_option: failed to write msgtype_rules");
-	    free(encbuf2);
+	    if (opt->type == OPTTYPE_AUTOPICKUP_RULES) {
+		type = 'a';
+		str = autopickup_to_string(opt->value.ar);
+	    } else {
+		type = 'm';
+		str = msgtype_to_string(opt->value.mt);
+	    }
+	    /* large numbers of rules might overflow valbuf */
+	    val = malloc(base64size(strlen(str)));
+	    base64_encode(str, val);
 	    free(str);
 	    break;
     }
     
+    out = malloc(strlen(encbuf) + strlen(val) + 5);
+    if (type)
+	sprintf(out, "!%s:%c:%s", encbuf, type, val);
+    else
+	sprintf(out, "!%s:", encbuf);
+    if (val != valbuf)
+	free(val);
+    
+    return out;
+}
+
+
+static void write_option(struct nh_option_desc *opt)
+{
+    char *str = log_encode_option(opt);
+    
+    /* bypass lprintf, which might overflow its buffer */
+    log_write("\n", 1);
+    log_write(str, strlen(str));
+    free(str);
+}
+
+
+void log_option(struct nh_option_desc *opt)
+{
+    if (iflags.disable_log || logfile == -1)
+	return;
+    
+    write_option(opt);
+    log_sync();
     last_cmd_pos = lseek(logfile, 0, SEEK_CUR);
 }
 
 
+/*
+ * Append the complete option state to a saved game, after the binary save
+ * data.  The footer at the very end of the file points to the start of the
+ * list, so that nh_restore_game() can find it without reading the whole log
+ * for the option changes recorded in it (see replay_read_option_snapshot).
+ */
+void log_save_options(int fd)
+{
+    int i;
+    long start;
+    boolean log_disabled = iflags.disable_log;
+    
+    if (fd == -1)
+	return;
+    
+    start = lseek(fd, 0, SEEK_CUR);
+    logfile = fd;
+    iflags.disable_log = FALSE;
+    
+    for (i = 0; active_birth_options[i].name; i++)
+	write_option(&active_birth_options[i]);
+    for (i = 0; options[i].name; i++)
+	write_option(&options[i]);
+    lprintf("\nTZ%d", replay_timezone);
+    lprintf(OPTION_FOOTER_FMT, start);
+    
+    log_sync();
+    iflags.disable_log = log_disabled;
+    logfile = -1;
+}
+
+
 static void log_game_opts(void)
 {
     int i;
@@ -233,6 +607,8 @@ void log_timezone(int tz_offset)
 	return;
     
     lprintf("\nTZ%d", tz_offset);
+    /* for log_save_options(); the value is otherwise only used during replay */
+    replay_timezone = tz_offset;
 }
 
 
@@ -262,6 +638,8 @@ void log_command(int cmd, int rep, struct nh_cmd_arg *arg)
 
 void log_command_result(void)
 {
+    boolean rewrite;
+
     if (iflags.disable_log || !program_state.something_worth_saving || logfile == -1)
 	return;
 
@@ -283,7 +661,8 @@ void log_command_result(void)
 		(last_cmd_state == &recent_cmd_states[0] ?
 		 &recent_cmd_states[1] : &recent_cmd_states[0]);
 
-	mnew(this_cmd_state, last_cmd_state);
+	/* reuse the buffers of the state from two commands ago */
+	mreset(this_cmd_state, last_cmd_state);
 	savegame(this_cmd_state); /* both records the state, and calcs a diff */
 	lprintf("\n~");
 	mdiffflush(this_cmd_state);
@@ -312,16 +691,33 @@ void log_command_result(void)
 	lprintf(" (%d edits (%d bytes), %d copies (%d bytes), %d seeks)",
 		edits, editbytes, copies, copybytes, seeks);
 #endif
-	mfree(last_cmd_state);
 	last_cmd_state = this_cmd_state;
 	action_count++;
     }
 
-    last_cmd_pos = lseek(logfile, 0, SEEK_CUR);
-    lseek(logfile, 0, SEEK_SET);
-    lprintf("NHGAME %4s %08x %08x", statuscodes[LS_IN_PROGRESS],
-	    last_cmd_pos, action_count);
-    lseek(logfile, last_cmd_pos, SEEK_SET);
+    /*
+     * Rewriting the header costs two seeks and a write at the start of an
+     * otherwise append-only file, so it may be done only every few commands.
+     * A crash in between loses nothing: replay_begin() looks for commands
+     * logged after the end recorded in the header.
+     */
+    rewrite = header_interval <= 1 ||
+	      action_count - header_action_count >= header_interval ||
+	      time(NULL) - header_time >= HEADER_MAX_AGE;
+    if (rewrite) {
+	header_action_count = action_count;
+	header_time = time(NULL);
+    }
+
+#ifdef LOG_WRITER_THREAD
+    if (log_queue_begin()) {
+	log_queue_job(rewrite ? LJ_HEADER : LJ_MARK, NULL, 0, NULL);
+	pthread_mutex_unlock(&lw.lock);
+	return;
+    }
+#endif
+    if (!write_header(logfile, action_count, rewrite))
+	panic("updating the log header failed.");
 }
 
 
@@ -332,6 +728,7 @@ void log_revert_command(void)
     if (logfile == -1 || iflags.disable_log)
 	return;
     
+    log_sync();
     lseek(logfile, last_cmd_pos, SEEK_SET);
     ftruncate(logfile, last_cmd_pos);
 }
@@ -432,8 +829,20 @@ static void log_binary(const char *buf, int buflen, char prefix[3])
     if (logfile == -1 || iflags.disable_log)
 	return;
 
+#ifdef LOG_WRITER_THREAD
+    if (log_queue_begin()) {
+	char *copy = malloc(buflen);
+	memcpy(copy, buf, buflen);
+	log_queue_job(LJ_BINARY, copy, buflen, prefix);
+	pthread_mutex_unlock(&lw.lock);
+	return;
+    }
+#endif
+
     b64buf = malloc(base64size(buflen));
-    base64_encode_binary((const unsigned char*)buf, b64buf, buflen);
+    if (!base64_encode_binary((const unsigned char*)buf, b64buf, buflen,
+			      log_compression))
+	panic("Could not compress input data!");
 
     /* don't use lprintf, b64buf might be too big for the buffer used by lprintf */
     if (!write_full(logfile, prefix, 3))
@@ -455,13 +864,18 @@ void log_bones(const char *bonesbuf, int buflen)
 
 void log_finish(enum nh_log_status status)
 {
+    /* the caller may be about to close or read the file */
+    log_sync();
+
     if (!program_state.something_worth_saving || logfile == -1 || iflags.disable_log)
 	return;
     
     lseek(logfile, last_cmd_pos++, SEEK_SET);
     lprintf("\n");
     lseek(logfile, 0, SEEK_SET);
-    lprintf("NHGAME %4s %08x", statuscodes[status], last_cmd_pos);
+    /* the action count too, header updates may have been skipped */
+    lprintf("NHGAME %4s %08x %08x", statuscodes[status], last_cmd_pos,
+	    action_count);
     lseek(logfile, last_cmd_pos, SEEK_SET);
     
     if (status != LS_IN_PROGRESS)
@@ -472,6 +886,7 @@ void log_finish(enum nh_log_status status)
 
 void log_truncate(void)
 {
+    log_sync();
     if (ftruncate(logfile, last_cmd_pos) < 0)
 	panic("Cannot truncate logfile");
 
@@ -483,6 +898,8 @@ void log_truncate(void)
 
 void log_init(void)
 {
+    header_action_count = action_count;
+    header_time = time(NULL);
     mfree(&recent_cmd_states[0]);
     mfree(&recent_cmd_states[1]);
     mnew(&recent_cmd_states[0], NULL);
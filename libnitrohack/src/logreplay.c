@@ -34,12 +34,19 @@ static char replay_yn_function(const char *query, const char *rset, char defchoi
 static void replay_getlin(const char *query, char *buf);
 
 
+#define LOG_READ_BLOCK 65536
+
 static struct loginfo {
     FILE *flog;
+    char *buf; /* the text of the log up to endpos, see next_log_token() */
     unsigned long endpos;
+    unsigned long loadstart, loaded; /* the part of buf that has been read */
+    unsigned long pos; /* offset of the next token in buf */
     long nonjumped_filepointer;
     long last_token_start;
     unsigned int actioncount;
+    unsigned int seed; /* the seed and start time identify the game */
+    unsigned long long starttime;
     boolean diffs_are_invalid;
     boolean cmds_are_invalid;
     boolean out_of_sync;
@@ -47,13 +54,26 @@ static struct loginfo {
 
 static struct memfile diff_base;
 
+#define CHECKPOINT_INTERVAL	1000	/* actions */
+#define MAX_LIVE_CHECKPOINTS	16	/* checkpoints with their data in memory */
+#define CPINDEX_MAGIC		"NHCPIDX1"
+#define CPINDEX_HEADER_LEN	24
+#define CPINDEX_RECORD_LEN	24
+#define CPINDEX_VERSION	((VERSION_MAJOR << 16) | (VERSION_MINOR << 8) | PATCHLEVEL)
+
 struct replay_checkpoint {
     int actions, moves, nexttoken;
-    struct nh_option_desc *opt; /* option state at the time of the checkpoint */
-    struct memfile cpdata; /* binary save data */
+    char *opt; /* option state at the time of the checkpoint, as log tokens */
+    struct memfile cpdata; /* binary save data; buf is NULL if not in memory */
+    long indexpos; /* compressed save data in the checkpoint index, or -1 */
+    int datalen, complen;
+    unsigned int lastuse;
 };
 
 static struct replay_checkpoint *checkpoints;
+static int cpindex = -1, next_cpindex = -1; /* see nh_view_replay_set_index */
+static int cpindex_actions; /* actions of the last checkpoint in the index */
+static unsigned int cpclock;
 static char **commands;
 static int cmdcount, cpcount;
 static struct nh_option_desc *saved_options;
@@ -140,7 +160,7 @@ static void base64_decode(const char *in, char *out)
 	free(o);
 	if (errcode != Z_OK) {
 	    raw_printf("Decompressing save file failed at %ld: %s",
-		       ftell(loginfo.flog),
+		       (long)loginfo.pos,
 		       errcode == Z_MEM_ERROR ? "Out of memory" :
 		       errcode == Z_BUF_ERROR ? "Invalid size" :
 		       errcode == Z_DATA_ERROR ? "Corrupted file" :
@@ -197,12 +217,17 @@ void replay_set_logfile(int logfd)
 
 void replay_begin(void)
 {
+    FILE *flog;
     long filesize;
     int i, dupped_fd;
-    boolean recovery = FALSE;
+    char status[5];
 
-    if (loginfo.flog)
+    if (loginfo.flog) {
 	fclose(loginfo.flog);
+	free(loginfo.buf);
+	loginfo.flog = NULL;
+	loginfo.buf = NULL;
+    }
 
     loginfo.diffs_are_invalid = FALSE;
     loginfo.cmds_are_invalid = FALSE;
@@ -212,64 +237,90 @@ void replay_begin(void)
     if (dupped_fd < 0)
 	panic("Could not duplicate file descriptor");
 
-    loginfo.flog = fdopen(dupped_fd, "rb");
-    if (!loginfo.flog)
+    flog = fdopen(dupped_fd, "rb");
+    if (!flog)
 	panic("Could not open save file with stdio");
 
-    fseek(loginfo.flog, 0, SEEK_END);
-    filesize = ftell(loginfo.flog);
-    fseek(loginfo.flog, 0, SEEK_SET);
+    fseek(flog, 0, SEEK_END);
+    filesize = ftell(flog);
+    fseek(flog, 0, SEEK_SET);
 
     if (filesize < 24 ||
-	!fscanf(loginfo.flog, "NHGAME %*4s %lx %x",
-		&loginfo.endpos, &loginfo.actioncount) ||
+	fscanf(flog, "NHGAME %4s %lx %x", status,
+	       &loginfo.endpos, &loginfo.actioncount) < 3 ||
 	loginfo.endpos > filesize) {
-	fclose(loginfo.flog);
-	loginfo.flog = NULL;
+	fclose(flog);
 	terminate();
     }
 
-    /* log_command_result() in log.c needs this to update the log header
-     * correctly, but getting this info there The Right Way involves
-     * mucking up file-reading state, hence this ugly hack. */
-    action_count = loginfo.actioncount;
-
-    if (!loginfo.endpos) {
-	loginfo.endpos = filesize;
-	recovery = TRUE;
-    }
-
-    if (recovery) {
-	/* The last token should always be a command diff.  So we look
-	 * backwards through the file for a line starting with ~.
-	 * Because standard file reading functions only look /forwards/,
-	 * we start 1024 bytes before the end of the file, and move 1024
-	 * bytes backwards if we don't find it, etc. */
-	long fstart = loginfo.endpos;
-	long found = -1;
-	while (fstart > 0) {
-	    char endbuf[1024];
+    if (!strcmp(status, "inpr")) {
+	/*
+	 * The game didn't end cleanly, or is still running.  The header is
+	 * only a lower bound on the end of the log: it is 0 before the first
+	 * command is logged, and if header updates are coalesced (see
+	 * log_command_result) there may be complete commands after it.
+	 * Every command ends with a line starting with ~, so look backwards
+	 * through the part of the file after the header's endpos for the
+	 * last one, counting them as we go.  Because standard file reading
+	 * functions only look /forwards/, we start 1024 bytes before the end
+	 * of the file, and move 1024 bytes backwards, etc.
+	 * If a later line was started, the last ~ line is complete and the
+	 * log ends where it does; otherwise it may have been cut short, and
+	 * the log is taken to end just before it.
+	 */
+	long blockend = filesize, fstart, pos;
+	long found = -1, foundend = -1, nextnl = -1;
+	int ncmds = 0;
+	while (blockend > (long)loginfo.endpos) {
+	    char endbuf[1025];
 	    int tread;
-	    fstart -= 1024;
-	    if (fstart < 0) fstart = 0;
-	    fseek(loginfo.flog, fstart, SEEK_SET);
-	    tread = fread(endbuf, 1,
-			  (loginfo.endpos - fstart > 1026 ? 1026 :
-			   loginfo.endpos - fstart),
-			  loginfo.flog);
-	    for (i = 0; i < tread - 1; i++) {
-		if ((endbuf[i] == '\r' || endbuf[i] == '\n') &&
-		    endbuf[i+1] == '~')
-		    found = i+1;
+	    fstart = blockend - 1024;
+	    if (fstart < (long)loginfo.endpos)
+		fstart = loginfo.endpos;
+	    /* one byte extra, for a newline at the end of the block that is
+	     * followed by a ~ at the start of the next one */
+	    fseek(flog, fstart, SEEK_SET);
+	    tread = fread(endbuf, 1, blockend - fstart + (blockend < filesize),
+			  flog);
+	    for (i = min(tread - 1, blockend - fstart) - 1; i >= 0; i--) {
+		if (endbuf[i] != '\r' && endbuf[i] != '\n')
+		    continue;
+		pos = fstart + i;
+		if (endbuf[i+1] == '~') {
+		    if (found < 0) {
+			found = pos + 1;
+			foundend = nextnl;
+		    }
+		    ncmds++;
+		}
+		nextnl = pos;
 	    }
-	    if (found > 0)
-		found += fstart;
+	    blockend = fstart;
+	}
+	if (found > 0 && foundend > 0) {
+	    loginfo.endpos = foundend;
+	    loginfo.actioncount += ncmds;
+	} else if (found > 0) {
+	    loginfo.endpos = found;
+	    loginfo.actioncount += ncmds - 1;
 	}
-	loginfo.endpos = found;
     }
 
+    /* log_command_result() in log.c needs this to update the log header
+     * correctly, but getting this info there The Right Way involves
+     * mucking up file-reading state, hence this ugly hack. */
+    action_count = loginfo.actioncount;
+
     last_cmd_pos = loginfo.endpos;
-    fseek(loginfo.flog, 0, SEEK_SET);
+
+    /* The text is read into buf in large blocks as the tokens are parsed
+     * (see replay_load_text), so a restore that only needs the start of the
+     * log doesn't read all of it. */
+    loginfo.flog = flog;
+    loginfo.buf = malloc(loginfo.endpos + 1);
+    loginfo.buf[0] = '\0';
+    loginfo.loadstart = loginfo.loaded = 0;
+    loginfo.pos = 0;
 
     mfree(&diff_base);
     mnew(&diff_base, NULL);
@@ -290,7 +341,9 @@ void replay_end(void)
 	return;
 
     fclose(loginfo.flog);
-    loginfo.flog = 0;
+    free(loginfo.buf);
+    loginfo.flog = NULL;
+    loginfo.buf = NULL;
 
     tz_off = get_tz_offset();
     if (tz_off != replay_timezone)
@@ -401,7 +454,7 @@ static long true_moves(void)
 static void NORETURN parse_error(const char *str)
 {
 #ifdef DEBUG
-    raw_printf("Error at file position: %ld\n", ftell(loginfo.flog), str);
+    raw_printf("Error at file position: %ld\n", loginfo.last_token_start, str);
 #else
     raw_printf("The command log seems to be in an outdated format.  "
 	       "The game will be replayed from diffs instead.");
@@ -411,42 +464,73 @@ static void NORETURN parse_error(const char *str)
 }
 
 
-/* note: returns a buffer that is overwritten on every call */
-static char *next_log_token(void)
+/*
+ * Make sure the log text from start up to upto has been read into
+ * loginfo.buf.  Only one contiguous part of the text is tracked; when a
+ * checkpoint is loaded, reading starts again from its position rather than
+ * from wherever the previous read stopped.
+ */
+static void replay_load_text(unsigned long start, unsigned long upto)
 {
-    static char *rbuf = NULL;
-    static int rbuflen = 0;
+    unsigned long want;
 
-    int rbpos = 0;
-    long filepos = ftell(loginfo.flog);
+    if (start < loginfo.loadstart || start > loginfo.loaded)
+	loginfo.loadstart = loginfo.loaded = start;
+    if (upto <= loginfo.loaded)
+	return;
 
-    loginfo.last_token_start = filepos;
+    want = min(max(upto, loginfo.loaded + LOG_READ_BLOCK), loginfo.endpos);
+    fseek(loginfo.flog, loginfo.loaded, SEEK_SET);
+    if (fread(loginfo.buf + loginfo.loaded, 1, want - loginfo.loaded,
+	      loginfo.flog) != want - loginfo.loaded) {
+	raw_printf("Unexpected EOF or error in save file");
+	terminate();
+    }
+    loginfo.loaded = want;
+    loginfo.buf[want] = '\0';
+}
+
+
+/*
+ * Tokens are separated by spaces and newlines.  Each token is terminated in
+ * place in loginfo.buf and returned from there, so it remains valid until
+ * replay_end() or load_checkpoint().  A '\0' left behind by an earlier call
+ * counts as whitespace, which allows rereading the log from any earlier
+ * position.
+ */
+static char *next_log_token(void)
+{
+    char *buf = loginfo.buf;
+    unsigned long pos = loginfo.pos;
+    char *token;
+
+    loginfo.last_token_start = pos;
     while (1) {
-	char c;
-	if (rbpos >= rbuflen) {
-	    rbuflen *= 2;
-	    if (rbuflen < 256) rbuflen = 256;
-	    rbuf = realloc(rbuf, rbuflen);
-	}
-	if (rbpos + filepos >= loginfo.endpos) {
-	    rbuf[rbpos] = 0;
-	    return rbpos ? rbuf : NULL;
-	}
-	if (fread(&c, 1, 1, loginfo.flog) != 1) {
-	    raw_printf("Unexpected EOF or error in save file");
-	    terminate();
-	}
-	rbuf[rbpos] = c;
-	if (c == '\r' || c == '\n' || c == ' ') {
-	    if (rbpos != 0) break;
-	    /* otherwise overwrite the redundant whitespace the next time
-	     * round the loop */
-	} else {
-	    rbpos++;
+	if (pos >= loginfo.endpos) {
+	    loginfo.pos = pos;
+	    return NULL;
 	}
+	replay_load_text(pos, pos + 1);
+	if (buf[pos] != ' ' && buf[pos] != '\r' && buf[pos] != '\n' &&
+	    buf[pos] != '\0')
+	    break;
+	pos++;
     }
-    rbuf[rbpos] = 0;
-    return rbuf;
+
+    /* buf[loaded] is always '\0', so this stops at the end of the text that
+     * has been read so far */
+    token = &buf[pos];
+    while (1) {
+	pos += strcspn(&buf[pos], " \r\n");
+	if (pos < loginfo.loaded || pos >= loginfo.endpos)
+	    break;
+	replay_load_text(pos, pos + 1);
+    }
+    if (pos < loginfo.endpos)
+	buf[pos++] = '\0';
+    loginfo.pos = pos;
+
+    return token;
 }
 
 
@@ -609,7 +693,7 @@ char *replay_bones(int *buflen)
     
     if (strncmp(token, "b:", 2) != 0) {
 	/* no bones to load */
-	fseek(loginfo.flog, loginfo.last_token_start, SEEK_SET);
+	loginfo.pos = loginfo.last_token_start;
 	return NULL;
     }
     
@@ -709,6 +793,8 @@ void replay_read_newgame(unsigned long long *init, int *playmode, char *namebuf,
 
     sscan_llx(next_log_token(), init);
     sscanf(next_log_token(), "%x", &seed);
+    loginfo.starttime = *init;
+    loginfo.seed = seed;
     *playmode = atoi(next_log_token());
     base64_decode(next_log_token(), namebuf);
     *initrole = str2role(next_log_token());
@@ -948,7 +1034,7 @@ static void replay_check_diff(char *token, boolean optonly, boolean fast)
 	    /* make sure there's enough room to do what we need to do */
 	    do_realloc = FALSE;
 	    while (mf.len < mf.pos + n) {
-		mf.len += 4096;
+		mf.len = mf.len ? mf.len * 2 : 4096;
 		do_realloc = TRUE;
 	    }
 	    if (do_realloc)
@@ -1017,19 +1103,17 @@ static void replay_check_diff(char *token, boolean optonly, boolean fast)
 	    if (!fast && mf.pos == diff_base.pos && !loginfo.cmds_are_invalid) {
 		int i;
 		struct memfile_tag origtag;
-		origtag.next = 0;
+		origtag.next = -1;
 		origtag.tagdata = 99;
 		origtag.tagtype = MTAG_START;
 		origtag.pos = 0;
 		struct memfile_tag *best_tag = &origtag;
 		for (dbpos = 0; dbpos < diff_base.pos; dbpos++) {
 		    if (mf.buf[dbpos] != diff_base.buf[dbpos]) {
-			for (i = 0; i < MEMFILE_HASHTABLE_SIZE; i++) {
-			    struct memfile_tag *tp;
-			    for (tp = diff_base.tags[i]; tp; tp = tp->next) {
-				if (tp->pos <= dbpos && tp->pos >= best_tag->pos)
-				    best_tag = tp;
-			    }
+			for (i = 0; i < diff_base.ntags; i++) {
+			    struct memfile_tag *tp = &diff_base.tagslab[i];
+			    if (tp->pos <= dbpos && tp->pos >= best_tag->pos)
+				best_tag = tp;
 			}
 			raw_printf("desync between recording and save at tag "
 				   "(%d, %ld) + %d bytes", (int)best_tag->tagtype,
@@ -1068,10 +1152,66 @@ static void replay_check_diff(char *token, boolean optonly, boolean fast)
 }
 
 
-static char *strdupnull(char *s)
+/*
+ * Set the options from the list that log_save_options() appended to a saved
+ * game.  This gives the same result as replay_run_cmdloop(TRUE, FALSE, TRUE),
+ * but doesn't need to read the whole log.  Returns FALSE if the game was
+ * saved without an option list.
+ */
+boolean replay_read_option_snapshot(void)
 {
-    if (s) return strdup(s);
-    return NULL;
+    char footer[OPTION_FOOTER_LEN + 1], *buf, *token;
+    unsigned long start;
+    long filepos, filesize;
+    int len;
+    struct nh_option_desc *tmp;
+
+    filepos = lseek(logfile, 0, SEEK_CUR);
+    filesize = lseek(logfile, 0, SEEK_END);
+    if (filesize < loginfo.endpos + OPTION_FOOTER_LEN)
+	goto fail;
+
+    lseek(logfile, filesize - OPTION_FOOTER_LEN, SEEK_SET);
+    if (read(logfile, footer, OPTION_FOOTER_LEN) != OPTION_FOOTER_LEN)
+	goto fail;
+    footer[OPTION_FOOTER_LEN] = '\0';
+    if (strncmp(footer, "\nNHOPTS ", 8) ||
+	sscanf(footer + 8, "%lx", &start) != 1 || start <= loginfo.endpos ||
+	start > filesize - OPTION_FOOTER_LEN)
+	goto fail;
+
+    len = filesize - OPTION_FOOTER_LEN - start;
+    buf = malloc(len + 1);
+    lseek(logfile, start, SEEK_SET);
+    if (read(logfile, buf, len) != len) {
+	free(buf);
+	goto fail;
+    }
+    buf[len] = '\0';
+    lseek(logfile, filepos, SEEK_SET);
+
+    /* see replay_run_cmdloop */
+    tmp = birth_options;
+    birth_options = active_birth_options;
+    active_birth_options = tmp;
+
+    for (token = strtok(buf, " \r\n"); token; token = strtok(NULL, " \r\n")) {
+	if (token[0] == '!')
+	    replay_read_option(token);
+	else if (token[0] == 'T')
+	    replay_read_timezone(token);
+    }
+
+    tmp = birth_options;
+    birth_options = active_birth_options;
+    active_birth_options = tmp;
+
+    free(buf);
+    return TRUE;
+
+fail:
+    lseek(logfile, filepos, SEEK_SET);
+    return FALSE;
 }
 
 
@@ -1099,7 +1239,7 @@ boolean replay_run_cmdloop(boolean optonly, boolean singlestep, boolean fast)
     birth_options = active_birth_options;
     active_birth_options = tmp;
 
-    token = strdupnull(next_log_token());
+    token = next_log_token();
 
     while (token) {
 	switch (token[0]) {
@@ -1140,8 +1280,7 @@ boolean replay_run_cmdloop(boolean optonly, boolean singlestep, boolean fast)
 		    replay_check_msg(token);
 		break;
 	}
-	free(token);
-	token = strdupnull(next_log_token());
+	token = next_log_token();
     }
 
 out:
@@ -1154,11 +1293,278 @@ out:
 }
 
 
+/*
+ * The checkpoint index is a file that keeps the checkpoints of a replay
+ * between viewings, so that the next viewer can jump straight to any part
+ * of the game.  It starts with CPINDEX_MAGIC, the game version and the
+ * seed and start time of the game, followed by one record per checkpoint:
+ *   actions, moves, nexttoken, option text length, save data length,
+ *   compressed save data length, option text, compressed save data
+ * Records are appended in the order of their actions.
+ */
+static boolean write_cpindex(const void *buf, int len)
+{
+    int ret;
+    const char *data = buf;
+
+    while (len > 0) {
+	ret = write(cpindex, data, len);
+	if (ret <= 0)
+	    return FALSE;
+	data += ret;
+	len -= ret;
+    }
+    return TRUE;
+}
+
+
+static boolean read_cpindex(void *buf, int len)
+{
+    int ret;
+    char *data = buf;
+
+    while (len > 0) {
+	ret = read(cpindex, data, len);
+	if (ret <= 0)
+	    return FALSE;
+	data += ret;
+	len -= ret;
+    }
+    return TRUE;
+}
+
+
+static void write_cpindex_header(void)
+{
+    struct memfile mf;
+
+    mnew(&mf, NULL);
+    mwrite(&mf, CPINDEX_MAGIC, 8);
+    mwrite32(&mf, CPINDEX_VERSION);
+    mwrite32(&mf, loginfo.seed);
+    mwrite64(&mf, loginfo.starttime);
+
+    lseek(cpindex, 0, SEEK_SET);
+    if (ftruncate(cpindex, 0) || !write_cpindex(mf.buf, mf.pos))
+	cpindex_actions = INT_MAX; /* not writable; don't try again */
+    mfree(&mf);
+}
+
+
+/* Add the checkpoints in the index that are not known yet. */
+static void read_checkpoint_index(void)
+{
+    char header[CPINDEX_HEADER_LEN], rec[CPINDEX_RECORD_LEN];
+    struct memfile mf;
+    struct replay_checkpoint *cp;
+    long pos, filesize;
+    int optlen;
+
+    cpindex_actions = 0;
+    filesize = lseek(cpindex, 0, SEEK_END);
+    lseek(cpindex, 0, SEEK_SET);
+    mnew(&mf, NULL);
+    if (filesize < CPINDEX_HEADER_LEN || !read_cpindex(header, CPINDEX_HEADER_LEN) ||
+	memcmp(header, CPINDEX_MAGIC, 8)) {
+	write_cpindex_header();
+	return;
+    }
+    mf.buf = header;
+    mf.len = CPINDEX_HEADER_LEN;
+    mf.pos = 8;
+    if (mread32(&mf) != CPINDEX_VERSION ||
+	mread32(&mf) != (int32_t)loginfo.seed ||
+	mread64(&mf) != (int64_t)loginfo.starttime) {
+	/* left over from a different game or version */
+	write_cpindex_header();
+	return;
+    }
+
+    pos = CPINDEX_HEADER_LEN;
+    while (pos + CPINDEX_RECORD_LEN <= filesize &&
+	   read_cpindex(rec, CPINDEX_RECORD_LEN)) {
+	cpcount++;
+	checkpoints = realloc(checkpoints, sizeof(struct replay_checkpoint) * cpcount);
+	cp = &checkpoints[cpcount-1];
+	mf.buf = rec;
+	mf.len = CPINDEX_RECORD_LEN;
+	mf.pos = 0;
+	cp->actions = mread32(&mf);
+	cp->moves = mread32(&mf);
+	cp->nexttoken = mread32(&mf);
+	optlen = mread32(&mf);
+	cp->datalen = mread32(&mf);
+	cp->complen = mread32(&mf);
+	cp->indexpos = pos + CPINDEX_RECORD_LEN + optlen;
+	cp->opt = NULL;
+	cp->lastuse = 0;
+	mnew(&cp->cpdata, NULL);
+
+	if (cp->actions <= cpindex_actions || cp->nexttoken > loginfo.endpos ||
+	    optlen <= 0 || cp->datalen <= 0 || cp->complen <= 0 ||
+	    cp->indexpos + cp->complen > filesize)
+	    goto bad_record;
+	cp->opt = malloc(optlen + 1);
+	if (!read_cpindex(cp->opt, optlen))
+	    goto bad_record;
+	cp->opt[optlen] = '\0';
+
+	cpindex_actions = cp->actions;
+	pos = cp->indexpos + cp->complen;
+	lseek(cpindex, pos, SEEK_SET);
+	/* checkpoint 0 is always made from the log */
+	if (cp->actions <= checkpoints[0].actions) {
+	    free(cp->opt);
+	    cpcount--;
+	}
+	continue;
+
+bad_record:
+	/* a crash while writing the record, or the log was cut short */
+	free(cp->opt);
+	cpcount--;
+	break;
+    }
+    if (pos < filesize && ftruncate(cpindex, pos))
+	cpindex_actions = INT_MAX;
+}
+
+
+static void write_checkpoint(struct replay_checkpoint *cp)
+{
+    struct memfile mf;
+    unsigned long complen;
+    unsigned char *comp;
+    long pos;
+    int optlen = strlen(cp->opt);
+
+    if (cpindex == -1 || cp->actions <= cpindex_actions)
+	return;
+
+    complen = compressBound(cp->datalen);
+    comp = malloc(complen);
+    if (compress2(comp, &complen, (unsigned char *)cp->cpdata.buf, cp->datalen,
+		  Z_DEFAULT_COMPRESSION) != Z_OK) {
+	free(comp);
+	return;
+    }
+
+    mnew(&mf, NULL);
+    mwrite32(&mf, cp->actions);
+    mwrite32(&mf, cp->moves);
+    mwrite32(&mf, cp->nexttoken);
+    mwrite32(&mf, optlen);
+    mwrite32(&mf, cp->datalen);
+    mwrite32(&mf, complen);
+    mwrite(&mf, cp->opt, optlen);
+    mwrite(&mf, comp, complen);
+    free(comp);
+
+    pos = lseek(cpindex, 0, SEEK_END);
+    if (write_cpindex(mf.buf, mf.pos)) {
+	cp->indexpos = pos + CPINDEX_RECORD_LEN + optlen;
+	cp->complen = complen;
+	cpindex_actions = cp->actions;
+    } else {
+	/* don't leave a partial record, and don't try again */
+	if (ftruncate(cpindex, pos)) {}
+	cpindex_actions = INT_MAX;
+    }
+    mfree(&mf);
+}
+
+
+/* Make sure the save data of a checkpoint is in memory. */
+static boolean load_checkpoint_data(struct replay_checkpoint *cp)
+{
+    unsigned long datalen = cp->datalen;
+    char *comp, *data;
+
+    cp->lastuse = ++cpclock;
+    if (cp->cpdata.buf)
+	return TRUE;
+    if (cp->indexpos < 0 || cpindex == -1)
+	return FALSE;
+
+    comp = malloc(cp->complen);
+    data = malloc(cp->datalen);
+    lseek(cpindex, cp->indexpos, SEEK_SET);
+    if (!read_cpindex(comp, cp->complen) ||
+	uncompress((unsigned char *)data, &datalen, (unsigned char *)comp,
+		   cp->complen) != Z_OK || datalen != cp->datalen) {
+	free(comp);
+	free(data);
+	return FALSE;
+    }
+    free(comp);
+
+    mnew(&cp->cpdata, NULL);
+    cp->cpdata.buf = data;
+    cp->cpdata.len = cp->datalen;
+    return TRUE;
+}
+
+
+/*
+ * Keep the save data of no more than MAX_LIVE_CHECKPOINTS checkpoints in
+ * memory, dropping the least recently used.  If a checkpoint is not in the
+ * index it is forgotten completely; the first and last ones are always kept.
+ */
+static void trim_checkpoints(void)
+{
+    int i, live = 0, lru;
+
+    for (i = 0; i < cpcount; i++)
+	if (checkpoints[i].cpdata.buf)
+	    live++;
+
+    while (live > MAX_LIVE_CHECKPOINTS) {
+	lru = -1;
+	for (i = 1; i < cpcount - 1; i++)
+	    if (checkpoints[i].cpdata.buf &&
+		(lru == -1 || checkpoints[i].lastuse < checkpoints[lru].lastuse))
+		lru = i;
+	if (lru == -1)
+	    break;
+
+	mfree(&checkpoints[lru].cpdata);
+	live--;
+	if (checkpoints[lru].indexpos < 0) {
+	    free(checkpoints[lru].opt);
+	    memmove(&checkpoints[lru], &checkpoints[lru+1],
+		    sizeof(struct replay_checkpoint) * (cpcount - lru - 1));
+	    cpcount--;
+	}
+    }
+}
+
+
+/* Find the last checkpoint at or before target actions or moves. */
+static int find_checkpoint(int target, boolean by_moves)
+{
+    int lo = 0, hi = cpcount - 1, mid, val;
+
+    while (lo < hi) {
+	mid = (lo + hi + 1) / 2;
+	val = by_moves ? checkpoints[mid].moves : checkpoints[mid].actions;
+	if (val <= target)
+	    lo = mid;
+	else
+	    hi = mid - 1;
+    }
+    return lo;
+}
+
+
 static void make_checkpoint(int actions)
 {
+    struct replay_checkpoint *cp;
+    char *str;
+    int i, optlen = 0;
+
     /* only make a checkpoint if enough actions have happened since the last
      * one and creating a checkpoint is safe */
-    if ((cpcount > 0 && (actions <= checkpoints[cpcount-1].actions + 1000 ||
+    if ((cpcount > 0 && (actions <= checkpoints[cpcount-1].actions + CHECKPOINT_INTERVAL ||
 	                 true_moves() <= checkpoints[cpcount-1].moves)) ||
 	multi || occupation) /* checkpointing while something is in progress doesn't work */
 	return;
@@ -1167,27 +1573,47 @@ static void make_checkpoint(int actions)
 
     cpcount++;
     checkpoints = realloc(checkpoints, sizeof(struct replay_checkpoint) * cpcount);
-    checkpoints[cpcount-1].actions = actions;
-    checkpoints[cpcount-1].moves = moves;
-    checkpoints[cpcount-1].nexttoken = ftell(loginfo.flog);
+    cp = &checkpoints[cpcount-1];
+    cp->actions = actions;
+    cp->moves = moves;
+    cp->nexttoken = loginfo.pos;
+    cp->indexpos = -1;
+    cp->complen = 0;
+    cp->lastuse = ++cpclock;
+
     /* the active option list must be saved: it is not part of the normal binary save */
-    checkpoints[cpcount-1].opt = clone_optlist(options);
-    mnew(&checkpoints[cpcount-1].cpdata, NULL);
-    savegame(&checkpoints[cpcount-1].cpdata);
-    checkpoints[cpcount-1].cpdata.len = checkpoints[cpcount-1].cpdata.pos;
-    checkpoints[cpcount-1].cpdata.pos = 0;
+    cp->opt = malloc(1);
+    cp->opt[0] = '\0';
+    for (i = 0; options[i].name; i++) {
+	str = log_encode_option(&options[i]);
+	cp->opt = realloc(cp->opt, optlen + strlen(str) + 2);
+	optlen += sprintf(cp->opt + optlen, "%s ", str);
+	free(str);
+    }
+
+    mnew(&cp->cpdata, NULL);
+    savegame(&cp->cpdata);
+    cp->cpdata.len = cp->datalen = cp->cpdata.pos;
+    cp->cpdata.pos = 0;
+
+    write_checkpoint(cp);
+    trim_checkpoints();
 }
 
 
 static int load_checkpoint(int idx)
 {
-    int playmode, i, irole, irace, igend, ialign;
+    int playmode, irole, irace, igend, ialign, actions;
     boolean cmd_invalid, diff_invalid;
-    char namebuf[BUFSZ];
+    char namebuf[BUFSZ], *opt, *token;
     
     if (idx < 0 || idx >= cpcount)
 	return -1;
     
+    /* checkpoint 0 is always in memory */
+    while (idx > 0 && !load_checkpoint_data(&checkpoints[idx]))
+	idx--;
+    
     cmd_invalid = loginfo.cmds_are_invalid;
     diff_invalid = loginfo.diffs_are_invalid;
     loginfo.out_of_sync = FALSE; /* we're destroying saved state anyway */
@@ -1198,7 +1624,7 @@ static int load_checkpoint(int idx)
     replay_begin();
     replay_read_newgame(&turntime, &playmode, namebuf,
 			&irole, &irace, &igend, &ialign);
-    fseek(loginfo.flog, checkpoints[idx].nexttoken, SEEK_SET);
+    loginfo.pos = checkpoints[idx].nexttoken;
 
     loginfo.cmds_are_invalid = cmd_invalid;
     loginfo.diffs_are_invalid = diff_invalid;
@@ -1215,13 +1641,18 @@ static int load_checkpoint(int idx)
     program_state.viewing = TRUE;
     program_state.game_running = TRUE;
     
-    /* restore the full option state of the time of the checkpoint */
-    for (i = 0; checkpoints[idx].opt[i].name; i++)
-	nh_set_option(checkpoints[idx].opt[i].name, checkpoints[idx].opt[i].value, FALSE);
+    /* restore the full option state of the time of the checkpoint;
+     * replay_read_option modifies the tokens, so use a copy */
+    opt = strdup(checkpoints[idx].opt);
+    for (token = strtok(opt, " "); token; token = strtok(NULL, " "))
+	replay_read_option(token);
+    free(opt);
 
     savegame(&diff_base);
 
-    return checkpoints[idx].actions;
+    actions = checkpoints[idx].actions;
+    trim_checkpoints(); /* may move checkpoints[idx] */
+    return actions;
 }
 
 
@@ -1230,7 +1661,7 @@ static void free_checkpoints(void)
     int i;
     
     for (i = 0; i < cpcount; i++) {
-	free_optlist(checkpoints[i].opt);
+	free(checkpoints[i].opt);
 	mfree(&(checkpoints[i].cpdata));
     }
     free(checkpoints);
@@ -1286,6 +1717,12 @@ boolean nh_view_replay_start(int fd, struct nh_window_procs *rwinprocs,
     update_inventory();
     make_checkpoint(0);
     
+    /* if another process is viewing this game, let it have the index */
+    cpindex = lock_fd(next_cpindex, 0) ? next_cpindex : -1;
+    next_cpindex = -1;
+    if (cpindex != -1)
+	read_checkpoint_index();
+    
     api_exit();
     
     return TRUE;
@@ -1328,9 +1765,7 @@ boolean nh_view_replay_step(struct nh_replay_info *info,
 	case REPLAY_BACKWARD:
 	    prev_actions = info->actions;
 	    target = prev_actions - count;
-	    for (i = 0; i < cpcount-1; i++)
-		if (checkpoints[i+1].actions >= target)
-		    break;
+	    i = find_checkpoint(target, FALSE);
 	
 	    /* rewind the entire game state to the checkpoint */
 	    info->actions = load_checkpoint(i);
@@ -1356,13 +1791,11 @@ boolean nh_view_replay_step(struct nh_replay_info *info,
 	    
 	case REPLAY_GOTO:
 	    target = count;
-	    if (target < true_moves()) {
-		for (i = 0; i < cpcount-1; i++)
-		    if (checkpoints[i+1].moves >= target)
-			break;
-		/* rewind the entire game state to the checkpoint */
+	    i = find_checkpoint(target, TRUE);
+	    if (target < true_moves() || checkpoints[i].actions > info->actions)
+		/* rewind the entire game state to the checkpoint, or skip
+		 * ahead to one from the checkpoint index */
 		info->actions = load_checkpoint(i);
-	    }
 	    
 	    did_action = info->actions < info->max_actions;
 	    while (true_moves() < count && did_action) {
@@ -1404,11 +1837,25 @@ void nh_view_replay_finish(void)
     replay_end();
     freedynamicdata();
     free_checkpoints();
+    unlock_fd(cpindex);
+    cpindex = -1;
     logfile = -1;
     iflags.disable_log = FALSE;
 }
 
 
+/*
+ * Use fd, which must be open for reading and writing, as the checkpoint index
+ * of the game that is viewed with the next nh_view_replay_start(); see
+ * read_checkpoint_index().  The caller keeps ownership of fd and may close it
+ * after nh_view_replay_finish().
+ */
+void nh_view_replay_set_index(int fd)
+{
+    next_cpindex = fd;
+}
+
+
 enum nh_log_status nh_get_savegame_status(int fd, struct nh_game_info *gi)
 {
     char header[128], status[8], encplname[PL_NSIZ * 2];
@@ -681,6 +681,7 @@ struct monst *clone_mon(struct monst *mon,
 	level->monlist = m2;
 	m2->m_id = flags.ident++;
 	if (!m2->m_id) m2->m_id = flags.ident++;	/* ident overflowed */
+	index_mid(m2, FM_FMON);
 	m2->mx = mm.x;
 	m2->my = mm.y;
 
@@ -885,6 +886,7 @@ struct monst *makemon(const struct permonst *ptr,
 	mtmp->m_id = flags.ident++;
 	if (!mtmp->m_id)
 	    mtmp->m_id = flags.ident++;	/* ident overflowed */
+	index_mid(mtmp, FM_FMON);
 	set_mon_data(mtmp, ptr, 0);
 	
 	if (mtmp->data->msound == MS_LEADER)
@@ -1180,6 +1182,37 @@ static struct rndmonst_state {
 	char mchoices[SPECIAL_PM];	/* value range is 0..127 */
 } rndmonst_state;
 
+/* running totals of rndmonst_state.mchoices[], so that a monster can be
+ * picked with a binary search instead of a scan over all of mons[];
+ * not saved, rebuilt whenever mchoices[] changes */
+static int mcumul[SPECIAL_PM];
+static boolean mcumul_stale = TRUE;
+
+/* the monster whose slice of the running totals contains ct,
+ * or SPECIAL_PM if ct is past the end */
+static int rndmonst_pick(int ct)
+{
+	int lo = LOW_PM, hi = SPECIAL_PM, mid, mndx, total = 0;
+
+	if (mcumul_stale) {
+	    for (mndx = LOW_PM; mndx < SPECIAL_PM; mndx++) {
+		total += rndmonst_state.mchoices[mndx];
+		mcumul[mndx] = total;
+	    }
+	    mcumul_stale = FALSE;
+	}
+
+	/* first mndx with mcumul[mndx] >= ct */
+	while (lo < hi) {
+	    mid = (lo + hi) / 2;
+	    if (mcumul[mid] >= ct)
+		hi = mid;
+	    else
+		lo = mid + 1;
+	}
+	return lo;
+}
+
 /* select a random monster type */
 const struct permonst *rndmonst(struct level *lev)
 {
@@ -1198,6 +1231,7 @@ const struct permonst *rndmonst(struct level *lev)
 	    boolean upper;
 
 	    rndmonst_state.choice_count = 0;
+	    mcumul_stale = TRUE;
 	    /* look for first common monster */
 	    for (mndx = LOW_PM; mndx < SPECIAL_PM; mndx++) {
 		if (!uncommon(dlev, mndx)) break;
@@ -1248,8 +1282,7 @@ const struct permonst *rndmonst(struct level *lev)
  *	Now, select a monster at random.
  */
 	ct = rnd(rndmonst_state.choice_count);
-	for (mndx = LOW_PM; mndx < SPECIAL_PM; mndx++)
-	    if ((ct -= (int)rndmonst_state.mchoices[mndx]) <= 0) break;
+	mndx = rndmonst_pick(ct);
 
 	if (mndx == SPECIAL_PM || uncommon(dlev, mndx)) {	/* shouldn't happen */
 	    warning("rndmonst: bad `mndx' [#%d]", mndx);
@@ -1269,6 +1302,7 @@ void reset_rndmonst(int mndx)
 	} else if (mndx < SPECIAL_PM) {
 	    rndmonst_state.choice_count -= rndmonst_state.mchoices[mndx];
 	    rndmonst_state.mchoices[mndx] = 0;
+	    mcumul_stale = TRUE;
 	} /* note: safe to ignore extinction of unique monsters */
 }
 
@@ -1285,6 +1319,30 @@ void restore_rndmonst_state(struct memfile *mf)
 {
 	rndmonst_state.choice_count = mread32(mf);
 	mread(mf, rndmonst_state.mchoices, sizeof(rndmonst_state.mchoices));
+	mcumul_stale = TRUE;
+}
+
+
+/* The first monster of the given class, or SPECIAL_PM if there are none.
+ *	Assumption #1:	monsters of a given class are contiguous in the
+ *			mons[] array.
+ */
+static int first_of_class(char monclass)
+{
+	static int class_first[MAXMCLASSES];
+	static boolean class_first_init = FALSE;
+	int mndx, i;
+
+	if (!class_first_init) {
+	    for (i = 0; i < MAXMCLASSES; i++)
+		class_first[i] = SPECIAL_PM;
+	    for (mndx = SPECIAL_PM - 1; mndx >= LOW_PM; mndx--)
+		class_first[(int)mons[mndx].mlet] = mndx;
+	    class_first_init = TRUE;
+	}
+	if (monclass < 0 || monclass >= MAXMCLASSES)
+	    return SPECIAL_PM;
+	return class_first[(int)monclass];
 }
 
 
@@ -1295,11 +1353,7 @@ boolean monclass_nogen(char monclass)
 {
 	int first, i;
 
-/*	Assumption #1:	monsters of a given class are contiguous in the
- *			mons[] array.
- */
-	for (first = LOW_PM; first < SPECIAL_PM; first++)
-	    if (mons[first].mlet == monclass) break;
+	first = first_of_class(monclass);
 	if (first == SPECIAL_PM) return FALSE;
 
 	for (i = first; i < SPECIAL_PM && mons[i].mlet == monclass; i++)
@@ -1323,11 +1377,7 @@ const struct permonst *mkclass(const d_level *dlev, char class, int spc)
 	    warning("mkclass called with bad class!");
 	    return NULL;
 	}
-/*	Assumption #1:	monsters of a given class are contiguous in the
- *			mons[] array.
- */
-	for (first = LOW_PM; first < SPECIAL_PM; first++)
-	    if (mons[first].mlet == class) break;
+	first = first_of_class(class);
 	if (first == SPECIAL_PM) return NULL;
 
 	for (last = first;
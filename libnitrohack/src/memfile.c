@@ -3,6 +3,12 @@
 
 #include "hack.h"
 
+#if defined(__AVX2__)
+# include <immintrin.h>
+#elif defined(__SSE2__)
+# include <emmintrin.h>
+#endif
+
 #ifdef IS_BIG_ENDIAN
 static unsigned short host_to_le16(unsigned short x) { return _byteswap16(x); }
 static unsigned int   host_to_le32(unsigned int x)   { return _byteswap32(x); }
@@ -23,32 +29,66 @@ static unsigned long long le64_to_host(unsigned long long x) { return x; }
 /* Creating and freeing memory files */
 void mnew(struct memfile *mf, struct memfile *relativeto)
 {
-	int i;
 	mf->buf = mf->diffbuf = NULL;
-	mf->len = mf->pos = mf->difflen = mf->diffpos = mf->relativepos = 0;
+	mf->len = mf->difflen = 0;
+	mf->tagslab = NULL;
+	mf->tagslablen = 0;
+	mf->sections = NULL;
+	mf->nsections = 0;
+	mreset(mf, relativeto);
+}
+
+
+/*
+ * Empty a memfile for reuse, without freeing its buffers.  log.c writes a
+ * save of much the same size after every command; keeping the buffers
+ * around avoids growing them from nothing each time.
+ */
+void mreset(struct memfile *mf, struct memfile *relativeto)
+{
+	int i;
+	mf->pos = mf->diffpos = mf->relativepos = 0;
 	mf->relativeto = relativeto;
 	mf->curcmd = MDIFF_INVALID; /* no command yet */
 	for (i = 0; i < MEMFILE_HASHTABLE_SIZE; i++)
-	    mf->tags[i] = NULL;
+	    mf->tags[i] = -1;
+	mf->ntags = 0;
+	for (i = 0; i < mf->nsections; i++)
+	    mf->sections[i].start = -1;
 }
 
 
 void mfree(struct memfile *mf)
 {
-	int i;
 	free(mf->buf);
 	free(mf->diffbuf);
+	free(mf->tagslab);
+	free(mf->sections);
 	mf->buf = NULL;
 	mf->diffbuf = NULL;
-	for (i = 0; i < MEMFILE_HASHTABLE_SIZE; i++) {
-	    struct memfile_tag *tag = mf->tags[i];
-	    while (tag) {
-		struct memfile_tag *nexttag = tag->next;
-		free(tag);
-		tag = nexttag;
-	    }
-	    mf->tags[i] = NULL;
-	}
+	mf->tagslab = NULL;
+	mf->ntags = mf->tagslablen = 0;
+	mf->sections = NULL;
+	mf->nsections = 0;
+}
+
+
+/*
+ * Make sure *buf has room for needed bytes.  Buffers grow geometrically, so
+ * a save of n bytes needs O(log n) reallocs rather than n/4096.
+ */
+static void mgrow(char **buf, int *len, int needed)
+{
+	int newlen = *len;
+
+	if (newlen >= needed)
+	    return;
+	if (newlen < 4096)
+	    newlen = 4096;
+	while (newlen < needed)
+	    newlen *= 2;
+	*buf = realloc(*buf, newlen);
+	*len = newlen;
 }
 
 
@@ -62,47 +102,162 @@ void mfree(struct memfile *mf)
  * they improve efficiency rather than being required for correctness.
  */
 
-void mwrite(struct memfile *mf, const void *buf, unsigned int num)
+static void mreserve(struct memfile *mf, unsigned int num)
+{
+	mgrow(&mf->buf, &mf->len, mf->pos + num);
+}
+
+
+/*
+ * Diff kernel.  runlen() returns the length of the run at the start of a and
+ * b in which the bytes are all equal (if equal is TRUE) or all different.
+ * Blocks of 32/16/8 bytes are compared at once, depending on what the
+ * compiler targets; only the block containing the end of the run is
+ * examined bytewise.
+ */
+#if defined(__GNUC__)
+# define first_bit(x)	__builtin_ctzll(x)
+#else
+static int first_bit(unsigned long long x)
+{
+	int i = 0;
+	while (!(x & 1)) {
+	    x >>= 1;
+	    i++;
+	}
+	return i;
+}
+#endif
+
+static unsigned int runlen(const char *a, const char *b, unsigned int n,
+			   boolean equal)
+{
+	unsigned int i = 0;
+
+#if defined(__AVX2__)
+	for (; i + 32 <= n; i += 32) {
+	    __m256i va = _mm256_loadu_si256((const __m256i *)(a + i));
+	    __m256i vb = _mm256_loadu_si256((const __m256i *)(b + i));
+	    unsigned int eqmask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(va, vb));
+	    unsigned int runmask = equal ? ~eqmask : eqmask;
+	    if (runmask)
+		return i + first_bit(runmask);
+	}
+#endif
+#if defined(__SSE2__)
+	for (; i + 16 <= n; i += 16) {
+	    __m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+	    __m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+	    unsigned int eqmask = _mm_movemask_epi8(_mm_cmpeq_epi8(va, vb));
+	    unsigned int runmask = (equal ? ~eqmask : eqmask) & 0xffff;
+	    if (runmask)
+		return i + first_bit(runmask);
+	}
+#endif
+#if !defined(IS_BIG_ENDIAN)
+	/* Portable version: the byte order of the loaded words must match
+	 * memory order for the lowest set bit to be the first byte. */
+	for (; i + 8 <= n; i += 8) {
+	    uint64_t wa, wb, x, runmask;
+	    memcpy(&wa, a + i, 8);
+	    memcpy(&wb, b + i, 8);
+	    x = wa ^ wb; /* nonzero bytes differ */
+	    if (equal)
+		runmask = x;
+	    else /* high bit set in the first zero byte of x */
+		runmask = (x - 0x0101010101010101ULL) & ~x & 0x8080808080808080ULL;
+	    if (runmask)
+		return i + first_bit(runmask) / 8;
+	}
+#endif
+	for (; i < n; i++)
+	    if ((a[i] == b[i]) != equal)
+		break;
+	return i;
+}
+
+
+/*
+ * Record count bytes at pos as a run of cmd (MDIFF_COPY or MDIFF_EDIT).  The
+ * runs are split exactly as if the bytes had been diffed one at a time.
+ */
+static void mdiffrun(struct memfile *mf, enum mdiff_cmd cmd, unsigned int count)
+{
+	unsigned int n;
+
+	while (count > 0) {
+	    /*
+	     * Note that mdiffflush is responsible for writing the actual data
+	     * that was edited, once we have a complete run of it.  So there's
+	     * no need to record the data anywhere but in buf, but pos must be
+	     * at the end of the run before it's flushed.
+	     */
+	    if (mf->curcmd != cmd || mf->curcount >= 0x3fff) {
+		mdiffflush(mf);
+		mf->curcount = 0;
+	    }
+	    mf->curcmd = cmd;
+	    n = min(count, 0x3fff - mf->curcount);
+	    mf->curcount += n;
+	    mf->pos += n;
+	    mf->relativepos += n;
+	    count -= n;
+	}
+}
+
+
+/* Diff num bytes one at a time; cheaper than runlen() for short writes. */
+static void mdiffbytes(struct memfile *mf, unsigned int num)
 {
-	boolean do_realloc = FALSE;
-	while (mf->len < mf->pos + num) {
-	    mf->len += 4096;
-	    do_realloc = TRUE;
+	while (num--) {
+	    enum mdiff_cmd cmd =
+		(mf->relativepos < mf->relativeto->pos &&
+		 mf->buf[mf->pos] == mf->relativeto->buf[mf->relativepos]) ?
+		MDIFF_COPY : MDIFF_EDIT;
+	    if (mf->curcmd != cmd || mf->curcount >= 0x3fff) {
+		mdiffflush(mf);
+		mf->curcount = 0;
+	    }
+	    mf->curcmd = cmd;
+	    mf->curcount++;
+	    mf->pos++;
+	    mf->relativepos++;
 	}
+}
 
-	if (do_realloc)
-	    mf->buf = realloc(mf->buf, mf->len);
+
+void mwrite(struct memfile *mf, const void *buf, unsigned int num)
+{
+	mreserve(mf, num);
 	memcpy(&mf->buf[mf->pos], buf, num);
 
 	if (!mf->relativeto) {
 	    mf->pos += num;
+	} else if (num < 16) {
+	    mdiffbytes(mf, num);
 	} else {
 	    /* calculate and record the diff as well */
-	    while (num--) {
-		if (mf->relativepos < mf->relativeto->pos &&
-		    mf->buf[mf->pos] == mf->relativeto->buf[mf->relativepos]) {
-		    if (mf->curcmd != MDIFF_COPY || mf->curcount >= 0x3fff) {
-			mdiffflush(mf);
-			mf->curcount = 0;
-		    }
-		    mf->curcmd = MDIFF_COPY;
-		    mf->curcount++;
-		} else {
-		    /*
-		     * Note that mdiffflush is responsible for writing the
-		     * actual data that was edited, once we have a complete
-		     * run of it. So there's no need to record the data
-		     * anywhere but in buf.
-		     */
-		    if (mf->curcmd != MDIFF_EDIT || mf->curcount >= 0x3fff) {
-			mdiffflush(mf);
-			mf->curcount = 0;
-		    }
-		    mf->curcmd = MDIFF_EDIT;
-		    mf->curcount++;
-		}
-		mf->pos++;
-		mf->relativepos++;
+	    while (num) {
+		unsigned int avail = 0, run;
+
+		if (mf->relativepos < mf->relativeto->pos)
+		    avail = min(num, mf->relativeto->pos - mf->relativepos);
+
+		run = avail ? runlen(&mf->buf[mf->pos],
+				     &mf->relativeto->buf[mf->relativepos],
+				     avail, TRUE)
+			    : 0;
+		mdiffrun(mf, MDIFF_COPY, run);
+		num -= run;
+		avail -= run;
+
+		/* past the end of relativeto, everything is an edit */
+		run = avail ? runlen(&mf->buf[mf->pos],
+				     &mf->relativeto->buf[mf->relativepos],
+				     avail, FALSE)
+			    : num;
+		mdiffrun(mf, MDIFF_EDIT, run);
+		num -= run;
 	    }
 	}
 }
@@ -159,14 +314,7 @@ out:
  */
 static void mdiffwrite(struct memfile *mf, const void *buf, unsigned int bytes)
 {
-	boolean do_realloc = FALSE;
-	while (mf->difflen < mf->diffpos + bytes) {
-	    mf->difflen += 4096;
-	    do_realloc = TRUE;
-	}
-
-	if (do_realloc)
-	    mf->diffbuf = realloc(mf->diffbuf, mf->difflen);
+	mgrow(&mf->diffbuf, &mf->difflen, mf->diffpos + bytes);
 	memcpy(&mf->diffbuf[mf->diffpos], buf, bytes);
 	mf->diffpos += bytes;
 }
@@ -202,25 +350,59 @@ void mdiffflush(struct memfile *mf)
  * to the pos of the tag in relativeto if it exists, and adds a seek
  * command to the diff, unless it would be redundant.
  */
-void mtag(struct memfile *mf, long tagdata, enum memfile_tagtype tagtype)
+static int mtag_bucket(long tagdata, enum memfile_tagtype tagtype)
 {
 	/*
 	 * 619 is chosen here because it's a prime number, and it's
 	 * approximately in the golden ratio with MEMFILE_HASHTABLE_SIZE.
 	 */
-	int bucket = (tagdata * 619 + (int)tagtype) % MEMFILE_HASHTABLE_SIZE;
-	struct memfile_tag *tag = malloc(sizeof(struct memfile_tag));
+	return (tagdata * 619 + (int)tagtype) % MEMFILE_HASHTABLE_SIZE;
+}
+
+
+static struct memfile_tag *mfindtag(struct memfile *mf, long tagdata,
+				    enum memfile_tagtype tagtype)
+{
+	int i;
+
+	for (i = mf->tags[mtag_bucket(tagdata, tagtype)]; i >= 0;
+	     i = mf->tagslab[i].next) {
+	    struct memfile_tag *tag = &mf->tagslab[i];
+	    if (tag->tagtype == tagtype && tag->tagdata == tagdata)
+		return tag;
+	}
+	return NULL;
+}
+
+
+static void maddtag(struct memfile *mf, long tagdata,
+		    enum memfile_tagtype tagtype, int pos)
+{
+	int bucket = mtag_bucket(tagdata, tagtype);
+	struct memfile_tag *tag;
+
+	if (mf->ntags == mf->tagslablen) {
+	    mf->tagslablen = mf->tagslablen ? mf->tagslablen * 2 : 256;
+	    mf->tagslab = realloc(mf->tagslab,
+				  mf->tagslablen * sizeof(struct memfile_tag));
+	}
+	tag = &mf->tagslab[mf->ntags];
 	tag->next = mf->tags[bucket];
 	tag->tagdata = tagdata;
 	tag->tagtype = tagtype;
-	tag->pos = mf->pos;
-	mf->tags[bucket] = tag;
+	tag->pos = pos;
+	mf->tags[bucket] = mf->ntags++;
+}
+
+
+void mtag(struct memfile *mf, long tagdata, enum memfile_tagtype tagtype)
+{
+	struct memfile_tag *tag;
+
+	maddtag(mf, tagdata, tagtype, mf->pos);
 
 	if (mf->relativeto) {
-	    for (tag = mf->relativeto->tags[bucket]; tag; tag = tag->next) {
-		if (tag->tagtype == tagtype && tag->tagdata == tagdata)
-		    break;
-	    }
+	    tag = mfindtag(mf->relativeto, tagdata, tagtype);
 	    if (tag && mf->relativepos != tag->pos) {
 		int offset = mf->relativepos - tag->pos;
 		if (mf->curcmd != MDIFF_SEEK) {
@@ -245,6 +427,75 @@ void mtag(struct memfile *mf, long tagdata, enum memfile_tagtype tagtype)
 }
 
 
+/*
+ * Sections.  msection_start() and msection_end() bracket the data written
+ * for section number sect.  mcopy_section() may be called in place of
+ * writing a section whose data is unchanged since the parent memfile was
+ * written; it copies the section's data and tags from the parent and emits
+ * exactly the diff that writing the same bytes via mwrite() would have.
+ * It returns FALSE if that isn't possible, and the caller must write the
+ * section normally.
+ */
+void msection_start(struct memfile *mf, int sect)
+{
+	if (sect >= mf->nsections) {
+	    int i, n = sect + 1;
+	    mf->sections = realloc(mf->sections, n * sizeof(struct memfile_section));
+	    for (i = mf->nsections; i < n; i++)
+		mf->sections[i].start = -1;
+	    mf->nsections = n;
+	}
+	mf->sections[sect].start = mf->pos;
+	mf->sections[sect].end = mf->pos;
+	mf->sections[sect].firsttag = mf->ntags;
+	mf->sections[sect].ntags = 0;
+}
+
+
+void msection_end(struct memfile *mf, int sect)
+{
+	struct memfile_section *ms = &mf->sections[sect];
+	ms->end = mf->pos;
+	ms->ntags = mf->ntags - ms->firsttag;
+}
+
+
+boolean mcopy_section(struct memfile *mf, int sect)
+{
+	struct memfile *parent = mf->relativeto;
+	struct memfile_section *ps;
+	struct memfile_tag *tag;
+	int i, len;
+
+	if (!parent || sect >= parent->nsections)
+	    return FALSE;
+	ps = &parent->sections[sect];
+	if (ps->start < 0 || ps->start != mf->relativepos)
+	    return FALSE;
+
+	/* Every tag in the section must be the one mtag() would look up, or
+	 * writing the data normally would have produced a seek there. */
+	for (i = ps->firsttag; i < ps->firsttag + ps->ntags; i++) {
+	    tag = &parent->tagslab[i];
+	    if (mfindtag(parent, tag->tagdata, tag->tagtype) != tag)
+		return FALSE;
+	}
+
+	len = ps->end - ps->start;
+	msection_start(mf, sect);
+	mreserve(mf, len);
+	memcpy(&mf->buf[mf->pos], &parent->buf[ps->start], len);
+	for (i = ps->firsttag; i < ps->firsttag + ps->ntags; i++) {
+	    tag = &parent->tagslab[i];
+	    maddtag(mf, tag->tagdata, tag->tagtype, mf->pos + tag->pos - ps->start);
+	}
+
+	mdiffrun(mf, MDIFF_COPY, len);
+	msection_end(mf, sect);
+	return TRUE;
+}
+
+
 void mread(struct memfile *mf, void *buf, unsigned int len)
 {
 	int rlen = min(len, mf->len - mf->pos);
@@ -970,6 +970,7 @@ struct level *alloc_level(d_level *levnum)
 	lev->rooms[0].hx = -1;
 	lev->subrooms[0].hx = -1;
 	lev->flags.hero_memory = 1;
+	lev->dirty = TRUE;
 
 	/* these are not part of the level structure, but are obly used while
 	 * making new levels */
@@ -12,6 +12,12 @@ static void extract_nexthere(struct obj *, struct obj **);
 
 extern struct obj *thrownobj;		/* defined in dothrow.c */
 
+/* Floor objects are numbered in the order they are placed.  lev->objlist is
+ * kept newest first, so sorting by floorseq recovers its order for objects
+ * found through lev->objects; see floor_objects_in_box().  Restored levels
+ * are renumbered by find_lev_obj(), which re-places every floor object. */
+static unsigned long long floor_seq;
+
 /*#define DEBUG_EFFECTS*/	/* show some messages for debugging */
 
 struct icp {
@@ -273,6 +279,7 @@ void replace_object(struct obj *obj, struct obj *otmp)
 	otmp->nexthere = obj->nexthere;
 	otmp->ox = obj->ox;
 	otmp->oy = obj->oy;
+	otmp->floorseq = obj->floorseq;
 	obj->nobj = otmp;
 	obj->nexthere = otmp;
 	extract_nobj(obj, &obj->olev->objlist);
@@ -1038,6 +1045,7 @@ void place_object(struct obj *otmp, struct level *lev, int x, int y)
 
     obj_no_longer_held(otmp);
     if (otmp->otyp == BOULDER) block_point(x,y);	/* vision */
+    mark_level_dirty(lev);
 
     /* obj goes under boulders */
     if (otmp2 && (otmp2->otyp == BOULDER)) {
@@ -1058,9 +1066,70 @@ void place_object(struct obj *otmp, struct level *lev, int x, int y)
     /* add to floor chain */
     otmp->nobj = lev->objlist;
     lev->objlist = otmp;
+    otmp->floorseq = ++floor_seq;
     if (otmp->timed) obj_timer_checks(otmp, x, y, 0);
 }
 
+
+struct floor_obj_ref {
+    struct obj *obj;
+    int pileidx;	/* position in the pile at obj->ox, obj->oy */
+};
+
+static int floor_obj_cmp(const void *p1, const void *p2)
+{
+    const struct floor_obj_ref *r1 = p1, *r2 = p2;
+
+    if (r1->obj->floorseq != r2->obj->floorseq)
+	return r1->obj->floorseq > r2->obj->floorseq ? -1 : 1;
+    /* Pieces split off an object share its floorseq.  splitobj() inserts
+     * them right after the original in both chains, so the pile order is
+     * also their lev->objlist order. */
+    return r1->pileidx - r2->pileidx;
+}
+
+/*
+ * Return the floor objects of lev inside the box lx..hx, ly..hy (inclusive) in
+ * lev->objlist order, so that a caller looking for objects near a position
+ * behaves exactly as if it had walked the whole of lev->objlist, but only
+ * visits the squares in the box.  The array is overwritten by the next call.
+ */
+struct obj **floor_objects_in_box(struct level *lev, int lx, int ly,
+				  int hx, int hy, int *count)
+{
+    static struct floor_obj_ref *refs;
+    static struct obj **objs;
+    static int maxobjs;
+    struct obj *otmp;
+    int x, y, i, n = 0;
+
+    if (lx < 0) lx = 0;
+    if (ly < 0) ly = 0;
+    if (hx > COLNO - 1) hx = COLNO - 1;
+    if (hy > ROWNO - 1) hy = ROWNO - 1;
+
+    for (x = lx; x <= hx; x++)
+	for (y = ly; y <= hy; y++)
+	    for (i = 0, otmp = lev->objects[x][y]; otmp; otmp = otmp->nexthere) {
+		if (n == maxobjs) {
+		    maxobjs = maxobjs ? maxobjs * 2 : 64;
+		    refs = realloc(refs, maxobjs * sizeof(struct floor_obj_ref));
+		    objs = realloc(objs, maxobjs * sizeof(struct obj *));
+		}
+		refs[n].obj = otmp;
+		refs[n].pileidx = i++;
+		n++;
+	    }
+
+    if (n > 1)
+	qsort(refs, n, sizeof(struct floor_obj_ref), floor_obj_cmp);
+    for (i = 0; i < n; i++)
+	objs[i] = refs[i].obj;
+
+    *count = n;
+    return objs;
+}
+
 #define ON_ICE(a) ((a)->recharged)
 #define ROT_ICE_ADJUSTMENT 2	/* rotting on ice takes 2 times as long */
 
@@ -1217,6 +1286,9 @@ void discard_minvent(struct monst *mtmp)
  */
 void obj_extract_self(struct obj *obj)
 {
+    if (obj->olev)
+	mark_level_dirty(obj->olev);
+
     switch (obj->where) {
 	case OBJ_FREE:
 	    break;
@@ -29,6 +29,7 @@ void remove_monster(struct level *lev, int x, int y)
 	     (!m->minvis || See_invisible)))
 	    unblock_point(x, y);
 	lev->monsters[x][y] = NULL;
+	mark_level_dirty(lev);
 }
 
 /* convert the monster index of an undead to its living counterpart */
@@ -1236,6 +1237,7 @@ void replmon(struct monst *mtmp, struct monst *mtmp2)
     }
     mtmp2->nmon = mtmp2->dlevel->monlist;
     mtmp2->dlevel->monlist = mtmp2;
+    index_mid(mtmp2, FM_FMON);
     if (u.ustuck == mtmp) u.ustuck = mtmp2;
     if (u.usteed == mtmp) u.usteed = mtmp2;
     if (mtmp2->isshk) replshk(mtmp,mtmp2);
@@ -1261,6 +1263,127 @@ void relmon(struct monst *mon)
 		if (mtmp)    mtmp->nmon = mon->nmon;
 		else	    panic("relmon: mon not in list.");
 	}
+	unindex_mid(mon);
+}
+
+/*
+ * Index of monster ids, so that find_mid() doesn't have to walk every
+ * monster chain.  Each entry records which chain (FM_FMON, FM_MIGRATE or
+ * FM_MYDOGS) the monster is currently on; the code that moves monsters
+ * between chains re-indexes them with the new chain, and dealloc_monst()
+ * drops them.  Monster ids are handed out sequentially, so the id masked
+ * by the table size is a good enough hash for linear probing.
+ */
+struct mid_entry {
+	unsigned id;
+	int chain;
+	struct monst *mon;	/* NULL marks an empty slot */
+};
+
+static struct mid_entry *mid_table;
+static unsigned mid_tabsize, mid_count;
+
+static struct mid_entry *mid_slot(unsigned id)
+{
+	unsigned i = id & (mid_tabsize - 1);
+
+	while (mid_table[i].mon && mid_table[i].id != id)
+	    i = (i + 1) & (mid_tabsize - 1);
+	return &mid_table[i];
+}
+
+static void grow_mid_table(void)
+{
+	struct mid_entry *old = mid_table;
+	unsigned i, oldsize = mid_tabsize;
+
+	mid_tabsize = oldsize ? oldsize * 2 : 256;
+	mid_table = calloc(mid_tabsize, sizeof(struct mid_entry));
+	for (i = 0; i < oldsize; i++)
+	    if (old[i].mon)
+		*mid_slot(old[i].id) = old[i];
+	free(old);
+}
+
+/* record that mon is now on the given chain */
+void index_mid(struct monst *mon, int chain)
+{
+	struct mid_entry *e;
+
+	if (!mon->m_id)
+	    return;	/* that's the hero's id */
+	if (2 * (mid_count + 1) > mid_tabsize)
+	    grow_mid_table();
+
+	e = mid_slot(mon->m_id);
+	if (!e->mon)
+	    mid_count++;
+	e->id = mon->m_id;
+	e->chain = chain;
+	e->mon = mon;
+}
+
+/* index every monster of a freshly restored chain */
+void index_monchn(struct monst *chain, int which)
+{
+	for (; chain; chain = chain->nmon)
+	    index_mid(chain, which);
+}
+
+/* forget mon; a copy that has taken over its id keeps its entry */
+void unindex_mid(struct monst *mon)
+{
+	struct mid_entry *e;
+	unsigned i, j, home;
+
+	if (!mid_count)
+	    return;
+	e = mid_slot(mon->m_id);
+	if (e->mon != mon)
+	    return;
+
+	/* backward-shift deletion keeps the probe sequences intact */
+	i = e - mid_table;
+	j = i;
+	for (;;) {
+	    j = (j + 1) & (mid_tabsize - 1);
+	    if (!mid_table[j].mon)
+		break;
+	    home = mid_table[j].id & (mid_tabsize - 1);
+	    /* move entry j back into the hole unless its home is in (i, j] */
+	    if (i <= j ? (home <= i || home > j) : (home <= i && home > j)) {
+		mid_table[i] = mid_table[j];
+		i = j;
+	    }
+	}
+	mid_table[i].mon = NULL;
+	mid_count--;
+}
+
+/* find the monster with the given id and which chain it's on */
+struct monst *lookup_mid(unsigned nid, int *chain)
+{
+	struct mid_entry *e;
+
+	if (!mid_count)
+	    return NULL;
+	e = mid_slot(nid);
+	if (e->mon)
+	    *chain = e->chain;
+	return e->mon;
+}
+
+void clear_mid_index(void)
+{
+	free(mid_table);
+	mid_table = NULL;
+	mid_tabsize = mid_count = 0;
+}
+
+void dealloc_monst(struct monst *mon)
+{
+	unindex_mid(mon);
+	free(mon);
 }
 
 /* remove effects of mtmp from other data structures */
@@ -764,8 +764,8 @@ not_special:
 #define SQSRCHRADIUS	5
 
       { int minr = SQSRCHRADIUS;	/* not too far away */
-	struct obj *otmp;
-	int xx, yy;
+	struct obj *otmp, **objs;
+	int xx, yy, i, nobjs;
 	int oomx, oomy, lmx, lmy;
 
 	/* cut down the search radius if it thinks character is closer. */
@@ -781,7 +781,9 @@ not_special:
 	    oomy = min(ROWNO-1, omy+minr);
 	    lmx = max(1, omx-minr);
 	    lmy = max(0, omy-minr);
-	    for (otmp = level->objlist; otmp; otmp = otmp->nobj) {
+	    objs = floor_objects_in_box(level, lmx, lmy, oomx, oomy, &nobjs);
+	    for (i = 0; i < nobjs; i++) {
+		otmp = objs[i];
 		/* monsters may pick rocks up, but won't go out of their way
 		   to grab them; this might hamper sling wielders, but it cuts
 		   down on move overhead by filtering out most common item */
@@ -814,6 +814,7 @@ void forget_levels(int percent)
 	/* forget first % of randomized indices */
 	count = ((count * percent) + 50) / 100;
 	for (i = 0; i < count; i++) {
+	    mark_level_dirty(levels[indices[i]]);
 	    levels[indices[i]]->flags.forgotten = TRUE;
 	    forget_map(levels[indices[i]], TRUE);
 	    forget_traps(levels[indices[i]]);
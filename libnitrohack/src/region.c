@@ -29,6 +29,11 @@ void remove_region(struct region *);
 
 
 static void reset_region_mids(struct region *);
+static struct region_index *region_index(struct level *);
+static void index_region(struct region_index *, struct region *, int);
+static void adjust_member(struct level *, unsigned, int);
+static int member_count(struct level *, unsigned);
+static void set_hero_in_region(struct region *, boolean);
 
 static const callback_proc callbacks[] = {
 #define INSIDE_GAS_CLOUD 0
@@ -50,14 +55,27 @@ static boolean inside_rect(struct nhrect *r, int x, int y)
  */
 static boolean inside_region(struct region *reg, int x, int y)
 {
-    int i;
+    struct nhrect *bb;
+    int i, w, h, rx, ry;
 
     if (reg == NULL || !inside_rect(&(reg->bounding_box), x, y))
 	return FALSE;
-    for (i = 0; i < reg->nrects; i++)
-	if (inside_rect(&(reg->rects[i]), x, y))
-	    return TRUE;
-    return FALSE;
+
+    bb = &reg->bounding_box;
+    w = bb->hx - bb->lx + 1;
+    if (!reg->insidemap) {
+	/* mark the squares of each rect within the bounding box */
+	h = bb->hy - bb->ly + 1;
+	reg->insidemap = malloc(w * h);
+	memset(reg->insidemap, 0, w * h);
+	for (i = 0; i < reg->nrects; i++)
+	    for (rx = max(reg->rects[i].lx, bb->lx);
+		 rx <= min(reg->rects[i].hx, bb->hx); rx++)
+		for (ry = max(reg->rects[i].ly, bb->ly);
+		     ry <= min(reg->rects[i].hy, bb->hy); ry++)
+		    reg->insidemap[(ry - bb->ly) * w + (rx - bb->lx)] = 1;
+    }
+    return reg->insidemap[(y - bb->ly) * w + (x - bb->lx)];
 }
 
 /*
@@ -122,6 +140,8 @@ static void add_rect_to_reg(struct region *reg, struct nhrect *rect)
     tmp_rect[reg->nrects] = *rect;
     reg->nrects++;
     reg->rects = tmp_rect;
+    free(reg->insidemap);
+    reg->insidemap = NULL;
     /* Update bounding box if needed */
     if (reg->bounding_box.lx > rect->lx)
 	reg->bounding_box.lx = rect->lx;
@@ -152,6 +172,7 @@ static void add_mon_to_reg(struct region *reg, struct monst *mon)
 	reg->max_monst += MONST_INC;
     }
     reg->monsters[reg->n_monst++] = mon->m_id;
+    adjust_member(reg->lev, mon->m_id, 1);
 }
 
 /*
@@ -165,6 +186,7 @@ static void remove_mon_from_reg(struct region *reg, struct monst *mon)
 	if (reg->monsters[i] == mon->m_id) {
 	    reg->n_monst--;
 	    reg->monsters[i] = reg->monsters[reg->n_monst];
+	    adjust_member(reg->lev, mon->m_id, -1);
 	    return;
 	}
 }
@@ -195,6 +217,7 @@ void free_region(struct region *reg)
 	    free(reg->rects);
 	if (reg->monsters)
 	    free(reg->monsters);
+	free(reg->insidemap);
 	free(reg);
     }
 }
@@ -221,6 +244,8 @@ void add_region(struct level *lev, struct region *reg)
     reg->lev = lev;
     lev->regions[lev->n_regions] = reg;
     lev->n_regions++;
+    if (lev->regidx)
+	index_region(lev->regidx, reg, 1);
     /* Check for monsters inside the region */
     for (i = reg->bounding_box.lx; i <= reg->bounding_box.hx; i++)
 	for (j = reg->bounding_box.ly; j <= reg->bounding_box.hy; j++) {
@@ -233,10 +258,7 @@ void add_region(struct level *lev, struct region *reg)
 		newsym(i, j);
 	}
     /* Check for player now... */
-    if (inside_region(reg, u.ux, u.uy))
-	set_hero_inside(reg);
-    else
-	clear_hero_inside(reg);
+    set_hero_in_region(reg, inside_region(reg, u.ux, u.uy));
 }
 
 /*
@@ -260,6 +282,8 @@ void remove_region(struct region *reg)
 		if (isok(x,y) && inside_region(reg, x, y) && cansee(x, y))
 		    newsym(x, y);
 
+    if (lev->regidx)
+	index_region(lev->regidx, reg, -1);
     free_region(reg);
     lev->regions[i] = lev->regions[lev->n_regions - 1];
     lev->regions[lev->n_regions - 1] = NULL;
@@ -281,6 +305,11 @@ void free_regions(struct level *lev)
 	free(lev->regions);
     lev->max_regions = 0;
     lev->regions = NULL;
+    if (lev->regidx) {
+	free(lev->regidx->members);
+	free(lev->regidx);
+	lev->regidx = NULL;
+    }
 }
 
 /*
@@ -320,6 +349,7 @@ void run_regions(struct level *lev)
 		if (!mtmp || mtmp->mhp <= 0 ||
 				(*callbacks[f_indx])(lev->regions[i], mtmp)) {
 		    /* The monster died, remove it from list */
+		    adjust_member(lev, lev->regions[i]->monsters[j], -1);
 		    k = (lev->regions[i]->n_monst -= 1);
 		    lev->regions[i]->monsters[j] = lev->regions[i]->monsters[k];
 		    lev->regions[i]->monsters[k] = 0;
@@ -335,8 +365,16 @@ void run_regions(struct level *lev)
  */
 boolean in_out_region(struct level *lev, xchar x, xchar y)
 {
+    struct region_index *ri;
     int i, f_indx;
 
+    /* nothing to enter or leave */
+    if (!lev->n_regions)
+	return TRUE;
+    ri = region_index(lev);
+    if (!ri->cover[x][y] && !ri->n_hero_inside)
+	return TRUE;
+
     /* First check if we can do the move */
     for (i = 0; i < lev->n_regions; i++) {
 	if (inside_region(lev->regions[i], x, y)
@@ -358,7 +396,7 @@ boolean in_out_region(struct level *lev, xchar x, xchar y)
     for (i = 0; i < lev->n_regions; i++)
 	if (hero_inside(lev->regions[i]) &&
 		!lev->regions[i]->attach_2_u && !inside_region(lev->regions[i], x, y)) {
-	    clear_hero_inside(lev->regions[i]);
+	    set_hero_in_region(lev->regions[i], FALSE);
 	    if (lev->regions[i]->leave_msg != NULL)
 		pline(lev->regions[i]->leave_msg);
 	    if ((f_indx = lev->regions[i]->leave_f) != NO_CALLBACK)
@@ -369,7 +407,7 @@ boolean in_out_region(struct level *lev, xchar x, xchar y)
     for (i = 0; i < lev->n_regions; i++)
 	if (!hero_inside(lev->regions[i]) &&
 		!lev->regions[i]->attach_2_u && inside_region(lev->regions[i], x, y)) {
-	    set_hero_inside(lev->regions[i]);
+	    set_hero_in_region(lev->regions[i], TRUE);
 	    if (lev->regions[i]->enter_msg != NULL)
 		pline(lev->regions[i]->enter_msg);
 	    if ((f_indx = lev->regions[i]->enter_f) != NO_CALLBACK)
@@ -385,6 +423,12 @@ boolean m_in_out_region(struct monst *mon, xchar x, xchar y)
 {
     int i, f_indx;
 
+    /* nothing to enter or leave */
+    if (!mon->dlevel->n_regions ||
+	(!region_index(mon->dlevel)->cover[x][y] &&
+	 !member_count(mon->dlevel, mon->m_id)))
+	return TRUE;
+
     /* First check if we can do the move */
     for (i = 0; i < mon->dlevel->n_regions; i++) {
 	if (inside_region(mon->dlevel->regions[i], x, y) &&
@@ -432,10 +476,8 @@ void update_player_regions(struct level *lev)
     int i;
 
     for (i = 0; i < lev->n_regions; i++)
-	if (!lev->regions[i]->attach_2_u && inside_region(lev->regions[i], u.ux, u.uy))
-	    set_hero_inside(lev->regions[i]);
-	else
-	    clear_hero_inside(lev->regions[i]);
+	set_hero_in_region(lev->regions[i], !lev->regions[i]->attach_2_u &&
+			   inside_region(lev->regions[i], u.ux, u.uy));
 }
 
 /*
@@ -445,6 +487,11 @@ void update_monster_region(struct monst *mon)
 {
     int i;
 
+    if (!mon->dlevel->n_regions ||
+	(!region_index(mon->dlevel)->cover[mon->mx][mon->my] &&
+	 !member_count(mon->dlevel, mon->m_id)))
+	return;
+
     for (i = 0; i < mon->dlevel->n_regions; i++) {
 	if (inside_region(mon->dlevel->regions[i], mon->mx, mon->my)) {
 	    if (!mon_in_region(mon->dlevel->regions[i], mon))
@@ -465,6 +512,9 @@ struct region *visible_region_at(struct level *lev, xchar x, xchar y)
 {
     int i;
 
+    if (!lev->n_regions || !region_index(lev)->cover[x][y])
+	return NULL;
+
     for (i = 0; i < lev->n_regions; i++)
 	if (inside_region(lev->regions[i], x, y) && lev->regions[i]->visible &&
 		lev->regions[i]->ttl != 0)
@@ -472,6 +522,136 @@ struct region *visible_region_at(struct level *lev, xchar x, xchar y)
     return NULL;
 }
 
+/*
+ * The region index: how many regions cover each square, how many regions
+ * the hero is inside, and how many monsters[] entries each monster has
+ * across the level's regions.  A square no region covers, entered by
+ * someone who isn't in any region, can't trigger anything.
+ */
+static struct region_index *region_index(struct level *lev)
+{
+    struct region_index *ri = lev->regidx;
+    int i;
+
+    if (!ri) {
+	ri = lev->regidx = malloc(sizeof (struct region_index));
+	memset(ri, 0, sizeof (struct region_index));
+	for (i = 0; i < lev->n_regions; i++)
+	    index_region(ri, lev->regions[i], 1);
+    }
+    return ri;
+}
+
+/* add (delta 1) or remove (delta -1) a region from the level's index */
+static void index_region(struct region_index *ri, struct region *reg, int delta)
+{
+    int x, y, i;
+
+    for (x = max(reg->bounding_box.lx, 0);
+	 x <= min(reg->bounding_box.hx, COLNO - 1); x++)
+	for (y = max(reg->bounding_box.ly, 0);
+	     y <= min(reg->bounding_box.hy, ROWNO - 1); y++)
+	    if (inside_region(reg, x, y))
+		ri->cover[x][y] += delta;
+    if (hero_inside(reg))
+	ri->n_hero_inside += delta;
+    for (i = 0; i < reg->n_monst; i++)
+	adjust_member(reg->lev, reg->monsters[i], delta);
+}
+
+static unsigned member_hash(unsigned id, int size)
+{
+    return (id * 2654435761U) & (size - 1);
+}
+
+static int member_count(struct level *lev, unsigned id)
+{
+    struct region_index *ri = region_index(lev);
+    int i;
+
+    if (!ri->members_size)
+	return 0;
+    for (i = member_hash(id, ri->members_size); ri->members[i].count;
+	 i = (i + 1) & (ri->members_size - 1))
+	if (ri->members[i].id == id)
+	    return ri->members[i].count;
+    return 0;
+}
+
+static void adjust_member(struct level *lev, unsigned id, int delta)
+{
+    struct region_index *ri;
+    struct region_member *m;
+    int i, j, k, mask;
+
+    if (!lev || !(ri = lev->regidx))
+	return;	/* picked up when the index is built */
+
+    if (delta > 0 && (ri->members_used + 1) * 2 > ri->members_size) {
+	struct region_member *old = ri->members;
+	int oldsize = ri->members_size;
+
+	ri->members_size = oldsize ? oldsize * 2 : 64;
+	ri->members = malloc(ri->members_size * sizeof (struct region_member));
+	memset(ri->members, 0, ri->members_size * sizeof (struct region_member));
+	for (i = 0; i < oldsize; i++) {
+	    if (!old[i].count)
+		continue;
+	    for (j = member_hash(old[i].id, ri->members_size);
+		 ri->members[j].count; j = (j + 1) & (ri->members_size - 1))
+		;
+	    ri->members[j] = old[i];
+	}
+	free(old);
+    }
+    if (!ri->members_size)
+	return;
+
+    mask = ri->members_size - 1;
+    for (i = member_hash(id, ri->members_size); ri->members[i].count;
+	 i = (i + 1) & mask)
+	if (ri->members[i].id == id)
+	    break;
+    m = &ri->members[i];
+
+    if (!m->count) {
+	if (delta < 0)
+	    return;
+	m->id = id;
+	ri->members_used++;
+    }
+    m->count += delta;
+    if (m->count > 0)
+	return;
+
+    /* empty the slot, shifting back any later entries of the probe run */
+    ri->members_used--;
+    for (j = i; ; ) {
+	j = (j + 1) & mask;
+	if (!ri->members[j].count)
+	    break;
+	k = member_hash(ri->members[j].id, ri->members_size);
+	if ((j > i && (k <= i || k > j)) || (j < i && k <= i && k > j)) {
+	    ri->members[i] = ri->members[j];
+	    i = j;
+	}
+    }
+    ri->members[i].count = 0;
+}
+
+/* set or clear REG_HERO_INSIDE, keeping the level's index in step */
+static void set_hero_in_region(struct region *reg, boolean inside)
+{
+    if (!hero_inside(reg) == !inside)
+	return;
+    if (reg->lev && reg->lev->regidx)
+	reg->lev->regidx->n_hero_inside += inside ? 1 : -1;
+    if (inside)
+	set_hero_inside(reg);
+    else
+	clear_hero_inside(reg);
+}
+
 /**
  * save_regions :
  */
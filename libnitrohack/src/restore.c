@@ -68,7 +68,10 @@ static void find_lev_obj(struct level *lev)
 	}
 	/* lev->objlist should now be empty */
 
-	/* Set lev->objects (as well as reversing the chain back again) */
+	/* Set lev->objects (as well as reversing the chain back again).
+	 * floorseq isn't saved; place_object() gives each object a fresh one,
+	 * and placing from the old tail to the old head keeps the newest-first
+	 * order that floor_objects_in_box() relies on. */
 	while ((otmp = fobjtmp) != 0) {
 		fobjtmp = otmp->nobj;
 		place_object(otmp, lev, otmp->ox, otmp->oy);
@@ -484,6 +487,7 @@ static void restgamestate(struct memfile *mf)
 	invent = restobjchn(mf, lev, FALSE, FALSE);
 	magic_chest_objs = restobjchn(mf, lev, FALSE, FALSE);
 	migrating_mons = restmonchn(mf, lev, FALSE);
+	index_monchn(migrating_mons, FM_MIGRATE);
 	restore_mvitals(mf);
 
 	/* this comes after inventory has been loaded */
@@ -746,15 +750,16 @@ void trickery(char *reason)
 }
 
 
-static void restore_location(struct memfile *mf, struct rm *loc)
+static void unpack_location(const unsigned char *buf, struct rm *loc)
 {
 	unsigned int lflags1;
 	unsigned int lflags2;
-	
-	lflags1 = mread32(mf);
-	loc->typ = mread8(mf);
-	loc->seenv = mread8(mf);
-	lflags2 = mread32(mf);
+
+	/* little-endian, like mread32 */
+	lflags1 = buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((unsigned)buf[3] << 24);
+	loc->typ = buf[4];
+	loc->seenv = buf[5];
+	lflags2 = buf[6] | (buf[7] << 8) | (buf[8] << 16) | ((unsigned)buf[9] << 24);
 
 	loc->mem_bg	    = (lflags1 >> 26) & ((1 <<  6) - 1);
 	loc->mem_trap	    = (lflags1 >> 21) & ((1 <<  5) - 1);
@@ -775,6 +780,19 @@ static void restore_location(struct memfile *mf, struct rm *loc)
 	loc->edge	    = (lflags2 >>  0) & ((1 <<  1) - 1);
 }
 
+/* Read the map written by save_locations() with a single mread. */
+static void restore_locations(struct memfile *mf, struct level *lev)
+{
+	static unsigned char buf[COLNO * ROWNO * LOCATION_SIZE];
+	const unsigned char *p = buf;
+	int x, y;
+
+	mread(mf, buf, sizeof(buf));
+	for (x = 0; x < COLNO; x++)
+	    for (y = 0; y < ROWNO; y++, p += LOCATION_SIZE)
+		unpack_location(p, &lev->locations[x][y]);
+}
+
 
 static struct trap *restore_traps(struct memfile *mf)
 {
@@ -840,9 +858,7 @@ struct level *getlev(struct memfile *mf, xchar levnum, boolean ghostly)
 	lev->z.dnum = mread8(mf);
 	lev->z.dlevel = mread8(mf);
 	mread(mf, lev->levname, sizeof(lev->levname));
-	for (x = 0; x < COLNO; x++)
-	    for (y = 0; y < ROWNO; y++)
-		restore_location(mf, &lev->locations[x][y]);
+	restore_locations(mf, lev);
 	
 	lev->lastmoves = mread32(mf);
 	mread(mf, &lev->upstair, sizeof(stairway));
@@ -892,6 +908,7 @@ struct level *getlev(struct memfile *mf, xchar levnum, boolean ghostly)
 	restore_timers(mf, lev, RANGE_LEVEL, ghostly, moves - lev->lastmoves);
 	restore_light_sources(mf, lev);
 	lev->monlist = restmonchn(mf, lev, ghostly);
+	index_monchn(lev->monlist, FM_FMON);
 
 	if (ghostly) {
 	    struct monst *mtmp2;
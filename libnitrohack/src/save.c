@@ -6,6 +6,7 @@
 #include "quest.h"
 
 static void savelevchn(struct memfile *mf);
+static void savelevdata(struct memfile *mf, struct level *lev);
 static void savedamage(struct memfile *mf, struct level *lev);
 static void freedamage(struct level *lev);
 static void save_mongen_override(struct memfile *mf, struct mon_gen_override *);
@@ -60,6 +61,7 @@ int dosave0(boolean emergency)
 
 	savegame(&mf);
 	store_mf(fd, &mf);	/* also frees mf */
+	log_save_options(fd);
 
 	freedynamicdata();
 
@@ -269,7 +271,7 @@ static void savegamestate(struct memfile *mf)
 }
 
 
-static void save_location(struct memfile *mf, struct rm *loc)
+static void pack_location(unsigned char *buf, const struct rm *loc)
 {
 	unsigned int lflags1;
 	unsigned int lflags2;
@@ -294,17 +296,36 @@ static void save_location(struct memfile *mf, struct rm *loc)
 		  (loc->roomno		<<  1) |
 		  (loc->edge		<<  0);
 
-	mwrite32(mf, lflags1);
-	mwrite8(mf, loc->typ);
-	mwrite8(mf, loc->seenv);
-	mwrite32(mf, lflags2);
+	/* little-endian, like mwrite32 */
+	buf[0] = lflags1;
+	buf[1] = lflags1 >> 8;
+	buf[2] = lflags1 >> 16;
+	buf[3] = lflags1 >> 24;
+	buf[4] = loc->typ;
+	buf[5] = loc->seenv;
+	buf[6] = lflags2;
+	buf[7] = lflags2 >> 8;
+	buf[8] = lflags2 >> 16;
+	buf[9] = lflags2 >> 24;
+}
+
+/* Write the whole map in one go; the layout is the same as writing each
+ * square with mwrite32/mwrite8, column by column. */
+static void save_locations(struct memfile *mf, struct level *lev)
+{
+	static unsigned char buf[COLNO * ROWNO * LOCATION_SIZE];
+	unsigned char *p = buf;
+	int x, y;
+
+	for (x = 0; x < COLNO; x++)
+	    for (y = 0; y < ROWNO; y++, p += LOCATION_SIZE)
+		pack_location(p, &lev->locations[x][y]);
+	mwrite(mf, buf, sizeof(buf));
 }
 
 
 void savelev(struct memfile *mf, xchar levnum)
 {
-	int x, y;
-	unsigned int lflags;
 	struct level *lev = levels[levnum];
 
 	if (lev->flags.purge_monsters) {
@@ -313,8 +334,31 @@ void savelev(struct memfile *mf, xchar levnum)
 		 * when changing levels without taking time -- e.g.
 		 * create statue trap then immediately level teleport) */
 		dmonsfree(lev);
+		mark_level_dirty(lev);
+	}
+
+	/* Levels other than the current one rarely change between commands,
+	 * so the diff save made after each command copies them out of the
+	 * previous save when they're clean. */
+	if (lev->dirty || lev == level || !mcopy_section(mf, levnum)) {
+	    msection_start(mf, levnum);
+	    savelevdata(mf, lev);
+	    msection_end(mf, levnum);
 	}
 
+	/* regions contain a timestamp, so they're never clean */
+	save_regions(mf, lev);
+
+	/* a diff memfile becomes the base for the next diff */
+	if (mf->relativeto)
+	    lev->dirty = FALSE;
+}
+
+
+static void savelevdata(struct memfile *mf, struct level *lev)
+{
+	unsigned int lflags;
+
 	/* mtagging for this already done in save_game */
 	mfmagic_set(mf, LEVEL_MAGIC);
 
@@ -322,9 +366,7 @@ void savelev(struct memfile *mf, xchar levnum)
 	mwrite8(mf, lev->z.dlevel);
 	mwrite(mf, lev->levname, sizeof(lev->levname));
 
-	for (x = 0; x < COLNO; x++)
-	    for (y = 0; y < ROWNO; y++)
-		save_location(mf, &lev->locations[x][y]);
+	save_locations(mf, lev);
 
 	mwrite32(mf, lev->lastmoves);
 	mwrite(mf, &lev->upstair, sizeof(stairway));
@@ -378,7 +420,6 @@ void savelev(struct memfile *mf, xchar levnum)
 	save_lvl_sounds(mf, lev->sounds);
 	save_engravings(mf, lev);
 	savedamage(mf, lev);
-	save_regions(mf, lev);
 }
 
 
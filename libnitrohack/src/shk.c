@@ -167,6 +167,7 @@ void shkgone(struct monst *mtmp)
 	char *p;
 	int sx, sy;
 
+	mark_level_dirty(shoplev);
 	remove_damage(mtmp, TRUE);
 	sroom->resident = NULL;
 	if (!search_special(shoplev, ANY_SHOP))
@@ -2802,6 +2803,7 @@ static void remove_damage(struct monst *shkp, boolean croaked)
 	uchar saw_walls = 0;
 	struct level *lev = levels[ledger_no(&ESHK(shkp)->shoplevel)];
 
+	mark_level_dirty(lev);
 	tmp_dam = lev->damagelist;
 	tmp2_dam = 0;
 	while (tmp_dam) {
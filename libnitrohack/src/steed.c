@@ -624,6 +624,7 @@ void place_monster(struct monst *mon, int x, int y)
     mon->mx = x;
     mon->my = y;
     mon->dlevel->monsters[x][y] = mon;
+    mark_level_dirty(mon->dlevel);
     if (mon->data == &mons[PM_GIANT_TURTLE])
 	block_point(x, y);
 }
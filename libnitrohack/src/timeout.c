@@ -1245,18 +1245,48 @@ void do_storms(void)
  */
 
 static const char *kind_name(short);
-static void print_queue(struct menulist *menu, timer_element *);
+static void print_queue(struct menulist *menu, struct timer_queue *);
+static timer_element *alloc_timer(void);
+static void free_timer(timer_element *);
+static boolean timer_before(const timer_element *, const timer_element *);
+static int timer_cmp(const void *, const void *);
+static void heap_up(struct timer_queue *, int);
+static void heap_down(struct timer_queue *, int);
+static void hash_timer(struct timer_queue *, timer_element *);
+static void unhash_timer(struct timer_queue *, timer_element *);
+static void set_timer_arg(struct timer_queue *, timer_element *, void *);
+static timer_element **sorted_timers(struct timer_queue *, int *);
+static timer_element **obj_timers(struct timer_queue *, const struct obj *, int *);
 static void insert_timer(struct level *lev, timer_element *gnu);
-static timer_element *remove_timer(timer_element **, short,void *);
-static const timer_element *peek_timer(const timer_element *, short, const void *);
+static void unlink_timer(struct timer_queue *, timer_element *);
+static timer_element *remove_timer(struct timer_queue *, short, void *);
+static timer_element *peek_timer(struct timer_queue *, short, const void *);
 static void write_timer(struct memfile *mf, timer_element *);
 static boolean mon_is_local(struct monst *);
 static boolean timer_is_local(timer_element *);
-static int maybe_write_timer(struct memfile *mf, struct level *lev, int range, boolean write_it);
+static int maybe_write_timer(struct memfile *mf, timer_element **, int, int, boolean);
+static int bad_obj_timer(struct level *, timer_element *);
 
 /* ordered timer list */
 static unsigned int timer_id;
 
+/*
+ * Each level keeps its timers in a binary heap, plus a hash on
+ * (func_index, arg) so stop_timer and friends don't have to search it.
+ *
+ * The timers used to live in a list sorted by timeout, where a new timer
+ * went in front of those with the same timeout.  The heap keeps that exact
+ * order, because it decides which of several timers due on the same turn
+ * runs first and the order in which timers are saved: ties are broken by
+ * insertion sequence, latest first.  Anything that needs the timers in
+ * order (saving, the wizard mode display, the object functions below)
+ * sorts a copy.
+ */
+static unsigned long timer_seq;
+
+/* freed timer elements, chained through hnext */
+static timer_element *timer_pool;
+
 
 void init_timeout(void)
 {
@@ -1300,21 +1330,25 @@ static const char *kind_name(short kind)
     return "unknown";
 }
 
-static void print_queue(struct menulist *menu, timer_element *base)
+static void print_queue(struct menulist *menu, struct timer_queue *q)
 {
-    timer_element *curr;
+    timer_element *curr, **list;
     char buf[BUFSZ];
+    int i, n;
 
-    if (!base) {
+    if (!q->count) {
 	add_menutext(menu,	"<empty>");
     } else {
 	add_menutext(menu,	"timeout  id   kind   call");
-	for (curr = base; curr; curr = curr->next) {
+	list = sorted_timers(q, &n);
+	for (i = 0; i < n; i++) {
+	    curr = list[i];
 	    sprintf(buf,	" %4u  %4u   %-6s #%d %s (%p)",
 		curr->timeout, curr->tid, kind_name(curr->kind),
 		curr->func_index, timeout_funcs[curr->func_index].name, curr->arg);
 	    add_menutext(menu, buf);
 	}
+	free(list);
     }
 }
 
@@ -1330,7 +1364,7 @@ int wiz_timeout_queue(void)
     add_menutext(&menu, "");
     add_menutext(&menu, "Active timeout queue:");
     add_menutext(&menu, "");
-    print_queue(&menu, level->lev_timers);
+    print_queue(&menu, &level->lev_timers);
 
     display_menu(menu.items, menu.icount, NULL, PICK_NONE, NULL);
     free(menu.items);
@@ -1346,19 +1380,20 @@ int wiz_timeout_queue(void)
 void run_timers(void)
 {
     timer_element *curr;
+    struct timer_queue *q = &level->lev_timers;
 
     /*
      * Always use the first element.  Elements may be added or deleted at
-     * any time.  The list is ordered, we are done when the first element
+     * any time.  The heap is ordered, we are done when the first element
      * is in the future.
      */
-    while (level->lev_timers && level->lev_timers->timeout <= moves) {
-	curr = level->lev_timers;
-	level->lev_timers = curr->next;
+    while (q->count && q->heap[0]->timeout <= moves) {
+	curr = q->heap[0];
+	unlink_timer(q, curr);
 
 	if (curr->kind == TIMER_OBJECT) ((struct obj *)(curr->arg))->timed--;
 	(*timeout_funcs[curr->func_index].f)(curr->arg, curr->timeout);
-	free(curr);
+	free_timer(curr);
     }
 }
 
@@ -1373,9 +1408,7 @@ boolean start_timer(struct level *lev, long when, short kind, short func_index,v
     if (func_index < 0 || func_index >= NUM_TIME_FUNCS)
 	panic("start_timer");
 
-    gnu = malloc(sizeof(timer_element));
-    memset(gnu, 0, sizeof(timer_element));
-    gnu->next = NULL;
+    gnu = alloc_timer();
     gnu->tid = timer_id++;
     gnu->timeout = moves + when;
     gnu->kind = kind;
@@ -1404,12 +1437,13 @@ long stop_timer(struct level *lev, short func_index, void *arg)
     doomed = remove_timer(&lev->lev_timers, func_index, arg);
 
     if (doomed) {
+	mark_level_dirty(lev);
 	timeout = doomed->timeout;
 	if (doomed->kind == TIMER_OBJECT)
 	    ((struct obj *)arg)->timed--;
 	if (timeout_funcs[doomed->func_index].cleanup)
 	    (*timeout_funcs[doomed->func_index].cleanup)(arg, timeout);
-	free(doomed);
+	free_timer(doomed);
 	return timeout;
     }
     return 0;
@@ -1424,7 +1458,7 @@ long report_timer(struct level *lev, short func_index, const void *arg)
 {
     const timer_element *checking;
 
-    checking = peek_timer(lev->lev_timers, func_index, arg);
+    checking = peek_timer(&lev->lev_timers, func_index, arg);
 
     if (checking)
 	return checking->timeout;
@@ -1438,15 +1472,16 @@ long report_timer(struct level *lev, short func_index, const void *arg)
  */
 void obj_move_timers(struct obj *src, struct obj *dest)
 {
-    int count;
-    timer_element *curr;
-
-    for (count = 0, curr = src->olev->lev_timers; curr; curr = curr->next)
-	if (curr->kind == TIMER_OBJECT && curr->arg == src) {
-	    curr->arg = dest;
-	    dest->timed++;
-	    count++;
-	}
+    int i, count;
+    timer_element **list;
+    struct timer_queue *q = &src->olev->lev_timers;
+
+    list = obj_timers(q, src, &count);
+    for (i = 0; i < count; i++) {
+	set_timer_arg(q, list[i], dest);
+	dest->timed++;
+    }
+    free(list);
     if (count != src->timed)
 	panic("obj_move_timers");
     src->timed = 0;
@@ -1458,15 +1493,14 @@ void obj_move_timers(struct obj *src, struct obj *dest)
  */
 void obj_split_timers(struct obj *src, struct obj *dest)
 {
-    timer_element *curr, *next_timer=0;
-
-    for (curr = src->olev->lev_timers; curr; curr = next_timer) {
-	next_timer = curr->next;	/* things may be inserted */
-	if (curr->kind == TIMER_OBJECT && curr->arg == src) {
-	    start_timer(dest->olev, curr->timeout-moves, TIMER_OBJECT,
-					curr->func_index, dest);
-	}
-    }
+    int i, count;
+    timer_element **list;
+
+    list = obj_timers(&src->olev->lev_timers, src, &count);
+    for (i = 0; i < count; i++)
+	start_timer(dest->olev, list[i]->timeout-moves, TIMER_OBJECT,
+		    list[i]->func_index, dest);
+    free(list);
 }
 
 
@@ -1476,70 +1510,247 @@ void obj_split_timers(struct obj *src, struct obj *dest)
  */
 void obj_stop_timers(struct obj *obj)
 {
-    timer_element *curr, *prev, *next_timer=0;
-
-    for (prev = 0, curr = obj->olev->lev_timers; curr; curr = next_timer) {
-	next_timer = curr->next;
-	if (curr->kind == TIMER_OBJECT && curr->arg == obj) {
-	    if (prev)
-		prev->next = curr->next;
-	    else
-		obj->olev->lev_timers = curr->next;
-	    if (timeout_funcs[curr->func_index].cleanup)
-		(*timeout_funcs[curr->func_index].cleanup)(curr->arg, curr->timeout);
-	    free(curr);
-	} else {
-	    prev = curr;
-	}
+    int i, count;
+    timer_element *curr, **list;
+    struct timer_queue *q = &obj->olev->lev_timers;
+
+    list = obj_timers(q, obj, &count);
+    for (i = 0; i < count; i++) {
+	curr = list[i];
+	unlink_timer(q, curr);
+	mark_level_dirty(obj->olev);
+	if (timeout_funcs[curr->func_index].cleanup)
+	    (*timeout_funcs[curr->func_index].cleanup)(curr->arg, curr->timeout);
+	free_timer(curr);
     }
+    free(list);
     obj->timed = 0;
 }
 
 
+static timer_element *alloc_timer(void)
+{
+    timer_element *t;
+
+    if (timer_pool) {
+	t = timer_pool;
+	timer_pool = t->hnext;
+    } else
+	t = malloc(sizeof(timer_element));
+    memset(t, 0, sizeof(timer_element));
+    return t;
+}
+
+
+static void free_timer(timer_element *t)
+{
+    t->hnext = timer_pool;
+    timer_pool = t;
+}
+
+
+/* Does a come before b in the queue? */
+static boolean timer_before(const timer_element *a, const timer_element *b)
+{
+    if (a->timeout != b->timeout)
+	return a->timeout < b->timeout;
+    return a->seq > b->seq;
+}
+
+
+static int timer_cmp(const void *a, const void *b)
+{
+    const timer_element *ta = *(const timer_element * const *)a;
+    const timer_element *tb = *(const timer_element * const *)b;
+
+    return timer_before(ta, tb) ? -1 : timer_before(tb, ta) ? 1 : 0;
+}
+
+
+static void heap_up(struct timer_queue *q, int pos)
+{
+    timer_element *t = q->heap[pos];
+    int parent;
+
+    while (pos > 0) {
+	parent = (pos - 1) / 2;
+	if (!timer_before(t, q->heap[parent]))
+	    break;
+	q->heap[pos] = q->heap[parent];
+	q->heap[pos]->hpos = pos;
+	pos = parent;
+    }
+    q->heap[pos] = t;
+    t->hpos = pos;
+}
+
+
+static void heap_down(struct timer_queue *q, int pos)
+{
+    timer_element *t = q->heap[pos];
+    int child;
+
+    while ((child = 2 * pos + 1) < q->count) {
+	if (child + 1 < q->count && timer_before(q->heap[child + 1], q->heap[child]))
+	    child++;
+	if (!timer_before(q->heap[child], t))
+	    break;
+	q->heap[pos] = q->heap[child];
+	q->heap[pos]->hpos = pos;
+	pos = child;
+    }
+    q->heap[pos] = t;
+    t->hpos = pos;
+}
+
+
+#define timer_hash(q, func_index, arg) \
+	((((unsigned long)(arg) >> 3) * 31 + (func_index)) & ((q)->hsize - 1))
+
+static void hash_timer(struct timer_queue *q, timer_element *t)
+{
+    int h = timer_hash(q, t->func_index, t->arg);
+
+    t->hnext = q->hash[h];
+    q->hash[h] = t;
+}
+
+
+static void unhash_timer(struct timer_queue *q, timer_element *t)
+{
+    timer_element **tp = &q->hash[timer_hash(q, t->func_index, t->arg)];
+
+    while (*tp != t)
+	tp = &(*tp)->hnext;
+    *tp = t->hnext;
+}
+
+
+/* change the argument of a queued timer; it's hashed on it */
+static void set_timer_arg(struct timer_queue *q, timer_element *t, void *arg)
+{
+    unhash_timer(q, t);
+    t->arg = arg;
+    hash_timer(q, t);
+}
+
+
+/* Return a copy of the queue in timeout order; the caller frees it. */
+static timer_element **sorted_timers(struct timer_queue *q, int *count)
+{
+    timer_element **list = malloc((q->count + 1) * sizeof(timer_element *));
+
+    memcpy(list, q->heap, q->count * sizeof(timer_element *));
+    qsort(list, q->count, sizeof(timer_element *), timer_cmp);
+    *count = q->count;
+    return list;
+}
+
+
+/* Return the timers of obj in timeout order; the caller frees the array. */
+static timer_element **obj_timers(struct timer_queue *q, const struct obj *obj,
+				  int *count)
+{
+    timer_element *curr, **list;
+    int f, n = 0, max = 4;
+
+    list = malloc(max * sizeof(timer_element *));
+    if (q->count) {
+	for (f = 0; f < NUM_TIME_FUNCS; f++)
+	    for (curr = q->hash[timer_hash(q, f, obj)]; curr; curr = curr->hnext)
+		if (curr->kind == TIMER_OBJECT && curr->arg == obj &&
+		    curr->func_index == f) {
+		    if (n == max) {
+			max *= 2;
+			list = realloc(list, max * sizeof(timer_element *));
+		    }
+		    list[n++] = curr;
+		}
+	qsort(list, n, sizeof(timer_element *), timer_cmp);
+    }
+    *count = n;
+    return list;
+}
+
+
 /* Insert timer into the global queue */
 static void insert_timer(struct level *lev, timer_element *gnu)
 {
-    timer_element *curr, *prev;
+    struct timer_queue *q = &lev->lev_timers;
+    timer_element *curr, *next;
+    int i, oldsize;
 
-    for (prev = 0, curr = lev->lev_timers; curr; prev = curr, curr = curr->next)
-	if (curr->timeout >= gnu->timeout) break;
+    if (q->count == q->size) {
+	q->size = q->size ? q->size * 2 : 16;
+	q->heap = realloc(q->heap, q->size * sizeof(timer_element *));
+    }
+    /* keep the hash no more than fully loaded */
+    if (q->count >= q->hsize) {
+	timer_element **oldhash = q->hash;
+
+	oldsize = q->hsize;
+	q->hsize = q->hsize ? q->hsize * 2 : 16;
+	q->hash = calloc(q->hsize, sizeof(timer_element *));
+	for (i = 0; i < oldsize; i++)
+	    for (curr = oldhash[i]; curr; curr = next) {
+		next = curr->hnext;
+		hash_timer(q, curr);
+	    }
+	free(oldhash);
+    }
 
-    gnu->next = curr;
-    if (prev)
-	prev->next = gnu;
-    else
-	lev->lev_timers = gnu;
+    gnu->seq = ++timer_seq;
+    q->heap[q->count++] = gnu;
+    heap_up(q, q->count - 1);
+    hash_timer(q, gnu);
+    mark_level_dirty(lev);
 }
 
 
-static timer_element *remove_timer(timer_element **base, short func_index,
-				   void * arg)
+/* Take timer t out of q without freeing it. */
+static void unlink_timer(struct timer_queue *q, timer_element *t)
 {
-    timer_element *prev, *curr;
+    timer_element *last;
+    int pos = t->hpos;
 
-    for (prev = 0, curr = *base; curr; prev = curr, curr = curr->next)
-	if (curr->func_index == func_index && curr->arg == arg) break;
+    unhash_timer(q, t);
+    last = q->heap[--q->count];
+    if (last == t)
+	return;
+    q->heap[pos] = last;
+    heap_up(q, pos);
+    heap_down(q, last->hpos);
+}
 
-    if (curr) {
-	if (prev)
-	    prev->next = curr->next;
-	else
-	    *base = curr->next;
-    }
+
+static timer_element *remove_timer(struct timer_queue *q, short func_index,
+				   void * arg)
+{
+    timer_element *curr;
+
+    curr = peek_timer(q, func_index, arg);
+    if (curr)
+	unlink_timer(q, curr);
 
     return curr;
 }
 
 
-static const timer_element *peek_timer(const timer_element *base,
-				       short func_index, const void *arg)
+/* Find the first timer in timeout order with the given (func_index, arg). */
+static timer_element *peek_timer(struct timer_queue *q,
+				 short func_index, const void *arg)
 {
-    const timer_element *curr;
+    timer_element *curr, *found = NULL;
 
-    for (curr = base; curr; curr = curr->next)
-	if (curr->func_index == func_index && curr->arg == arg) break;
+    if (!q->count)
+	return NULL;
 
-    return curr;
+    for (curr = q->hash[timer_hash(q, func_index, arg)]; curr; curr = curr->hnext)
+	if (curr->func_index == func_index && curr->arg == arg &&
+	    (!found || timer_before(curr, found)))
+	    found = curr;
+
+    return found;
 }
 
 
@@ -1633,15 +1844,17 @@ static boolean timer_is_local(timer_element *timer)
 
 
 /*
- * Part of the save routine.  Count up the number of timers that would
- * be written.  If write_it is true, actually write the timer.
+ * Part of the save routine.  Count up the number of timers in list that
+ * would be written.  If write_it is true, actually write the timer.
  */
-static int maybe_write_timer(struct memfile *mf, struct level *lev, int range, boolean write_it)
+static int maybe_write_timer(struct memfile *mf, timer_element **list, int n,
+			     int range, boolean write_it)
 {
-    int count = 0;
+    int i, count = 0;
     timer_element *curr;
 
-    for (curr = lev->lev_timers; curr; curr = curr->next) {
+    for (i = 0; i < n; i++) {
+	curr = list[i];
 	if (range == RANGE_GLOBAL) {
 	    /* global timers */
 
@@ -1667,115 +1880,123 @@ static int maybe_write_timer(struct memfile *mf, struct level *lev, int range, b
 
 void transfer_timers(struct level *oldlev, struct level *newlev, unsigned int obj_id)
 {
-    timer_element *curr, *prev = NULL, *next_timer = NULL;
+    struct timer_queue *q = &oldlev->lev_timers;
+    timer_element *curr, **list;
+    int i, n = 0;
 
     if (newlev == oldlev)
 	return;
 
-    for (curr = oldlev->lev_timers; curr; curr = next_timer) {
-	next_timer = curr->next;	/* in case curr is removed */
-
-	/* transfer global timers or timers of requested object */
+    /* transfer global timers or timers of requested object */
+    list = malloc((q->count + 1) * sizeof(timer_element *));
+    for (i = 0; i < q->count; i++) {
+	curr = q->heap[i];
 	if ((!obj_id && !timer_is_local(curr)) ||
 	    (obj_id && curr->kind == TIMER_OBJECT &&
-	     ((struct obj *)curr->arg)->o_id == obj_id)) {
-	    if (prev)
-		prev->next = curr->next;
-	    else
-		oldlev->lev_timers = curr->next;
+	     ((struct obj *)curr->arg)->o_id == obj_id))
+	    list[n++] = curr;
+    }
+    /* in queue order, which decides their order on the new level */
+    qsort(list, n, sizeof(timer_element *), timer_cmp);
 
-	    insert_timer(newlev, curr);
-	    /* prev stays the same */
-	} else {
-	    prev = curr;
-	}
+    for (i = 0; i < n; i++) {
+	unlink_timer(q, list[i]);
+	mark_level_dirty(oldlev);
+	insert_timer(newlev, list[i]);
     }
+    free(list);
 }
 
 
 /*
- * Verify that the timer chains of all levels are as they should be, and if
- * not, fix them.
+ * Check an object timer found on lev.  Returns one of the problems below,
+ * or 0 if there's nothing wrong with it.
+ */
+#define TIMER_NULL_OBJ	1
+#define TIMER_UNTIMED	2
+#define TIMER_WRONG_LEV	3
+static int bad_obj_timer(struct level *lev, timer_element *curr)
+{
+    struct obj *o_arg = (struct obj *)curr->arg;
+    struct level *right_lev;
+
+    if (curr->kind != TIMER_OBJECT)
+	return 0;
+
+    /* sanity check */
+    if (!o_arg)
+	return TIMER_NULL_OBJ;
+
+    /* check if object should be timed */
+    if (!o_arg->timed)
+	return TIMER_UNTIMED;
+
+    /*
+     * Check that the timer is on the right level:
+     *
+     *  - local object timers should be on the same level as their object
+     *  - global object timers should be on the player's current level
+     */
+    right_lev = timer_is_local(curr) ? o_arg->olev : level;
+    if (!right_lev)
+	panic("validate_timers: right_lev is null");
+    return lev != right_lev ? TIMER_WRONG_LEV : 0;
+}
+
+
+/*
+ * Verify that the timer queues of all levels are as they should be, and if
+ * not, fix them.  The heap can't be out of order, so this only has to check
+ * object timers.
  */
 void validate_timers(void)
 {
-    int i;
+    int i, j, n;
 
     for (i = 0; i <= maxledgerno(); i++) {
-	timer_element *curr;
-	timer_element *next;
-	timer_element *move_me;
-	unsigned int curr_timeout;
-	unsigned int last_timeout = 0;
+	struct timer_queue *q;
+	timer_element *curr, *move_me, **list;
 	struct level *lev = levels[i];
 
 	if (!lev)
 	    continue;
+	q = &lev->lev_timers;
 
-	for (curr = lev->lev_timers; curr; curr = next, last_timeout = curr_timeout) {
-	    struct level *right_lev;
-
-	    next = curr->next;		  /* in case curr is moved */
-	    curr_timeout = curr->timeout; /* ditto */
-
-	    if (curr->kind == TIMER_OBJECT) {
-		struct obj *o_arg = (struct obj *)curr->arg;
-
-		/* sanity check */
-		if (!o_arg) {
-		    warning("validate_timers: object timer with null object, removing");
-		    stop_timer(lev, curr->func_index, curr->arg);
-		    continue;
-		}
+	/* quick pass first; problems are rare */
+	for (j = 0; j < q->count; j++)
+	    if (bad_obj_timer(lev, q->heap[j]))
+		break;
+	if (j == q->count)
+	    continue;
 
-		/* check if object should be timed */
-		if (!o_arg->timed) {
-		    /* If the timer and the object's timed flag disagree, the
-		     * timer is probably in the wrong, so delete it. */
-		    warning("validate_timers: timer attached to untimed object, removing");
-		    stop_timer(lev, curr->func_index, curr->arg);
-		    continue;
-		}
+	list = sorted_timers(q, &n);
+	for (j = 0; j < n; j++) {
+	    curr = list[j];
+	    switch (bad_obj_timer(lev, curr)) {
+	    case TIMER_NULL_OBJ:
+		warning("validate_timers: object timer with null object, removing");
+		stop_timer(lev, curr->func_index, curr->arg);
+		break;
 
-		/*
-		 * Check that the timer is on the right level:
-		 *
-		 *  - local object timers should be on the same level as their object
-		 *  - global object timers should be on the player's current level
-		 */
-		right_lev = timer_is_local(curr) ? o_arg->olev : level;
-		if (!right_lev) {
-		    panic("validate_timers: right_lev is null");
-		} else if (lev != right_lev) {
-		    warning("validate_timers: timer found on wrong level, fixing");
-		    move_me = remove_timer(&lev->lev_timers, curr->func_index, curr->arg);
-		    if (!move_me)
-			panic("validate_timers: what the hell?");
-		    insert_timer(right_lev, move_me);
-		    continue;
-		}
-	    }
+	    case TIMER_UNTIMED:
+		/* If the timer and the object's timed flag disagree, the
+		 * timer is probably in the wrong, so delete it. */
+		warning("validate_timers: timer attached to untimed object, removing");
+		stop_timer(lev, curr->func_index, curr->arg);
+		break;
 
-	    /* make sure timers are in ascending order */
-	    if (timer_is_local(curr)) {
-		right_lev = (curr->kind == TIMER_OBJECT) ?
-				((struct obj *)curr->arg)->olev :
-				lev;
-	    } else {
-		right_lev = level;
-	    }
-	    if (!right_lev)
-		panic("validate_timers: right_lev is null");
-	    if (curr->timeout < last_timeout) {
-		/* insertion sort */
-		warning("validate_timers: timer found out of order, reordering");
-		move_me = remove_timer(&lev->lev_timers, curr->func_index, curr->arg);
+	    case TIMER_WRONG_LEV:
+		warning("validate_timers: timer found on wrong level, fixing");
+		move_me = remove_timer(q, curr->func_index, curr->arg);
 		if (!move_me)
 		    panic("validate_timers: what the hell?");
-		insert_timer(right_lev, move_me);
-		continue;
+		mark_level_dirty(lev);
+		insert_timer(timer_is_local(move_me) ?
+			     ((struct obj *)move_me->arg)->olev : level, move_me);
+		break;
 	    }
 	}
+	free(list);
     }
 }
 
@@ -1795,27 +2016,31 @@ void validate_timers(void)
  */
 void save_timers(struct memfile *mf, struct level *lev, int range)
 {
-    int count;
+    int count, n;
+    timer_element **list;
 
     mtag(mf, 2 * (int)ledger_no(&lev->z) + range, MTAG_TIMERS);
     if (range == RANGE_GLOBAL)
 	mwrite32(mf, timer_id);
 
-    count = maybe_write_timer(mf, lev, range, FALSE);
+    list = sorted_timers(&lev->lev_timers, &n);
+    count = maybe_write_timer(mf, list, n, range, FALSE);
     mwrite32(mf, count);
-    maybe_write_timer(mf, lev, range, TRUE);
+    maybe_write_timer(mf, list, n, range, TRUE);
+    free(list);
 }
 
 
 void free_timers(struct level *lev)
 {
-    timer_element *curr, *next = NULL;
+    struct timer_queue *q = &lev->lev_timers;
+    int i;
 
-    for (curr = lev->lev_timers; curr; curr = next) {
-	next = curr->next;
-	free(curr);
-    }
-    lev->lev_timers = NULL;
+    for (i = 0; i < q->count; i++)
+	free_timer(q->heap[i]);
+    free(q->heap);
+    free(q->hash);
+    memset(q, 0, sizeof(struct timer_queue));
 }
 
 
@@ -1837,7 +2062,7 @@ void restore_timers(struct memfile *mf, struct level *lev, int range,
     /* restore elements */
     count = mread32(mf);
     while (count-- > 0) {
-	curr = malloc(sizeof(timer_element));
+	curr = alloc_timer();
 	
 	curr->tid = mread32(mf);
 	curr->timeout = mread32(mf);
@@ -1857,10 +2082,13 @@ void restore_timers(struct memfile *mf, struct level *lev, int range,
 /* reset all timers that are marked for reseting */
 void relink_timers(boolean ghostly, struct level *lev)
 {
+    struct timer_queue *q = &lev->lev_timers;
     timer_element *curr;
     unsigned nid;
+    int i;
 
-    for (curr = lev->lev_timers; curr; curr = curr->next) {
+    for (i = 0; i < q->count; i++) {
+	curr = q->heap[i];
 	if (curr->needs_fixup) {
 	    if (curr->kind == TIMER_OBJECT) {
 		if (ghostly) {
@@ -1868,7 +2096,7 @@ void relink_timers(boolean ghostly, struct level *lev)
 			panic("relink_timers 1");
 		} else
 		    nid = (long) curr->arg;
-		curr->arg = find_oid(lev, nid);
+		set_timer_arg(q, curr, find_oid(lev, nid));
 		if (!curr->arg) panic("cant find o_id %d", nid);
 		curr->needs_fixup = 0;
 	    } else
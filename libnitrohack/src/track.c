@@ -55,6 +55,17 @@ coord *gettrack(int x, int y)
 }
 
 
+/* copy up to max of the hero's recorded positions, latest first */
+int get_track(coord *out, int max)
+{
+    int i, n = min(utcnt, max);
+
+    for (i = 0; i < n; i++)
+	out[i] = utrack[(utpnt - 1 - i + UTSZ) % UTSZ];
+    return n;
+}
+
+
 void save_track(struct memfile *mf)
 {
     int i;
@@ -209,6 +209,7 @@ struct trap *maketrap(struct level *lev, int x, int y, int typ)
 	struct rm *loc;
 	boolean oldplace;
 
+	mark_level_dirty(lev);
 	if ((ttmp = t_at(lev, x,y)) != 0) {
 	    if (ttmp->ttyp == MAGIC_PORTAL) return NULL;
             if (ttmp->ttyp == VIBRATING_SQUARE) return NULL;
@@ -3800,6 +3801,8 @@ void deltrap(struct level *lev, struct trap *trap)
 {
 	struct trap *ttmp;
 
+	mark_level_dirty(lev);
+
 	if (trap == lev->lev_traps)
 		lev->lev_traps = lev->lev_traps->ntrap;
 	else {
@@ -86,6 +86,24 @@ static char *viz_clear_rows[ROWNO];
 static char  left_ptrs[ROWNO][COLNO];		/* LOS algorithm helpers */
 static char right_ptrs[ROWNO][COLNO];
 
+/*
+ * viz_clear again, as one bit per column in two 64 bit words per row, so
+ * clear_path() can test a run of a row at once.
+ */
+static uint64_t viz_clear_bits[ROWNO][2];
+
+/*
+ * The squares clear_path() checks between two points depend only on how
+ * far apart they are, so they are worked out once for every (dx,dy) >= 0
+ * and mirrored as needed.  For each row a line of that size crosses,
+ * line_rows[] holds the range of column offsets it crosses there.
+ */
+struct line_row {
+    xchar lo, hi;	/* lo > hi if the line doesn't touch the row */
+};
+static struct line_row line_rows[COLNO * ROWNO * (ROWNO+1) / 2];
+#define line_index(adx,ady) ((ady)*((ady)+1)/2*COLNO + (adx)*((ady)+1))
+
 /* Forward declarations. */
 static void fill_point(int,int);
 static void dig_point(int,int);
@@ -93,6 +111,10 @@ static void view_from(int,int,char **,char *,char *,int,
 			     void (*)(int,int,void *),void *);
 static void get_unused_cs(char ***,char **,char **);
 static void rogue_vision(char **,char *,char *);
+static void init_line_rows(void);
+static boolean clear_span(int,int,int);
+static boolean clear_path_pointwise(int,int,int,int);
+static int next_vis_col(const char *,const char *,int,int);
 
 /* Macro definitions that I can't find anywhere. */
 #define sign(z) ((z) < 0 ? -1 : ((z) ? 1 : 0 ))
@@ -124,6 +146,8 @@ void vision_init(void)
 
     vision_full_recalc = 0;
     memset(could_see, 0, sizeof(could_see));
+
+    init_line_rows();
 }
 
 /*
@@ -217,8 +241,14 @@ void vision_reset(void)
 	    right_ptrs[y][i] = (COLNO-1);
 	    viz_clear[y][i] = !block;
 	}
+
+	viz_clear_bits[y][0] = viz_clear_bits[y][1] = 0;
+	for (x = 0; x < COLNO; x++)
+	    if (viz_clear[y][x])
+		viz_clear_bits[y][x >> 6] |= (uint64_t)1 << (x & 63);
     }
 
+    flush_light_cache();	/* viz_clear has been rebuilt */
     iflags.vision_inited = 1;	/* vision is ready */
     vision_full_recalc = 1;	/* we want to run vision_recalc() */
 }
@@ -470,7 +500,6 @@ void vision_recalc(int control)
     struct rm *loc;	/* pointer to current pos */
     struct rm *flev;	/* pointer to position in "front" of current pos */
     extern unsigned char seenv_matrix[3][3];	/* from display.c */
-    static unsigned char colbump[COLNO+1];	/* cols to bump sv */
     unsigned char *sv;				/* ptr to seen angle bits */
     int oldseenv;				/* previous seenv value */
 
@@ -653,7 +682,6 @@ void vision_recalc(int control)
      *	    Even so, that is not entirely correct.  But it seems close
      *	    enough for now.
      */
-    colbump[u.ux] = colbump[u.ux+1] = 1;
     for (row = 0; row < ROWNO; row++) {
 	dy = u.uy - row;                dy = sign(dy);
 	next_row = next_array[row];     old_row = temp_array[row];
@@ -661,12 +689,12 @@ void vision_recalc(int control)
 	/* Find the min and max positions on the row. */
 	start = min(viz_rmin[row], next_rmin[row]);
 	stop  = max(viz_rmax[row], next_rmax[row]);
-	loc = &level->locations[start][row];
 
-	sv = &seenv_matrix[dy+1][start < u.ux ? 0 : (start > u.ux ? 2:1)];
-
-	for (col = start; col <= stop;
-				loc += ROWNO, sv += (int) colbump[++col]) {
+	/* Positions neither array could see need nothing, so skip them. */
+	for (col = next_vis_col(old_row, next_row, start, stop); col <= stop;
+		col = next_vis_col(old_row, next_row, col + 1, stop)) {
+	    loc = &level->locations[col][row];
+	    sv = &seenv_matrix[dy+1][col < u.ux ? 0 : (col > u.ux ? 2:1)];
 	    if (next_row[col] & IN_SIGHT) {
 		/*
 		 * We see this position because of night- or xray-vision.
@@ -750,7 +778,6 @@ not_in_sight:
 
 	} /* end for col . . */
     }	/* end for row . .  */
-    colbump[u.ux] = colbump[u.ux+1] = 0;
 
 skip:
     /* This newsym() caused a crash delivering msg about failure to open
@@ -775,8 +802,7 @@ skip:
 void block_point(int x, int y)
 {
     fill_point(y,x);
-
-    /* recalc light sources here? */
+    light_sources_topology_changed(x, y);
 
     /*
      * We have to do a full vision recalculation if we "could see" the
@@ -796,8 +822,7 @@ void block_point(int x, int y)
 void unblock_point(int x, int y)
 {
     dig_point(y,x);
-
-    /* recalc light sources here? */
+    light_sources_topology_changed(x, y);
 
     if (viz_array[y][x]) vision_full_recalc = 1;
 }
@@ -858,6 +883,7 @@ static void dig_point(int row, int col)
     if (viz_clear[row][col]) return;		/* already done */
 
     viz_clear[row][col] = 1;
+    viz_clear_bits[row][col >> 6] |= (uint64_t)1 << (col & 63);
 
     /*
      * Boundary cases first.
@@ -937,6 +963,7 @@ static void fill_point(int row, int col)
     if (!viz_clear[row][col]) return;
 
     viz_clear[row][col] = 0;
+    viz_clear_bits[row][col >> 6] &= ~((uint64_t)1 << (col & 63));
 
     if (col == 0) {
 	if (viz_clear[row][1]) {			/* adjacent is clear */
@@ -1240,13 +1267,10 @@ static int q3_path(int srow, int scol, int y2, int x2)
 
 
 /*
- * Use vision tables to determine if there is a clear path from
- * (col1,row1) to (col2,row2).  This is used by:
- *		m_cansee()
- *		m_canseeu()
- *		do_light_sources()
+ * The original clear_path(), which walks the line one point at a time.
+ * wiz_vision_bench() compares clear_path() against it.
  */
-boolean clear_path(int col1, int row1, int col2, int row2)
+static boolean clear_path_pointwise(int col1, int row1, int col2, int row2)
 {
     int result;
 
@@ -1269,6 +1293,249 @@ boolean clear_path(int col1, int row1, int col2, int row2)
 }
 
 
+/*
+ * Fill in line_rows[] with the points q1_path() .. q4_path() would visit.
+ * All four take the same steps away from the start, just in different
+ * directions, so one walk with dx,dy >= 0 covers them.
+ */
+static void init_line_rows(void)
+{
+    int adx, ady, k, x, y, err;
+    struct line_row *lr;
+
+    for (ady = 0; ady < ROWNO; ady++)
+	for (adx = 0; adx < COLNO; adx++) {
+	    lr = &line_rows[line_index(adx, ady)];
+	    for (y = 0; y <= ady; y++) {
+		lr[y].lo = COLNO;
+		lr[y].hi = -1;
+	    }
+	    if (!adx && !ady)
+		continue;
+
+	    x = y = 0;
+	    if (ady > adx) {
+		err = (adx << 1) - ady;
+		for (k = ady-1; k; k--) {
+		    if (err >= 0) {
+			x++;
+			err -= ady << 1;
+		    }
+		    y++;
+		    err += adx << 1;
+		    if (lr[y].lo > x) lr[y].lo = x;
+		    if (lr[y].hi < x) lr[y].hi = x;
+		}
+	    } else {
+		err = (ady << 1) - adx;
+		for (k = adx-1; k; k--) {
+		    if (err >= 0) {
+			y++;
+			err -= adx << 1;
+		    }
+		    x++;
+		    err += ady << 1;
+		    if (lr[y].lo > x) lr[y].lo = x;
+		    if (lr[y].hi < x) lr[y].hi = x;
+		}
+	    }
+	}
+}
+
+
+/* Are columns x1 through x2 of the row all clear? */
+static boolean clear_span(int row, int x1, int x2)
+{
+    const uint64_t *w = viz_clear_bits[row];
+    uint64_t mask;
+    int i;
+
+    for (i = x1 >> 6; i <= x2 >> 6; i++) {
+	mask = ~(uint64_t)0;
+	if (i == x1 >> 6)
+	    mask &= ~(uint64_t)0 << (x1 & 63);
+	if (i == x2 >> 6)
+	    mask &= ~(uint64_t)0 >> (63 - (x2 & 63));
+	if ((w[i] & mask) != mask)
+	    return FALSE;
+    }
+    return TRUE;
+}
+
+
+/*
+ * Use vision tables to determine if there is a clear path from
+ * (col1,row1) to (col2,row2).  This is used by:
+ *		m_cansee()
+ *		m_canseeu()
+ *		do_light_sources()
+ *
+ * This checks the same points as q1_path() .. q4_path(), but a row at a
+ * time, using line_rows[] and viz_clear_bits[].
+ */
+boolean clear_path(int col1, int row1, int col2, int row2)
+{
+    const struct line_row *lr;
+    int adx = v_abs(col2 - col1), ady = v_abs(row2 - row1);
+    int sy = (row2 < row1) ? -1 : 1;
+    int y;
+
+    lr = &line_rows[line_index(adx, ady)];
+    for (y = 0; y <= ady; y++) {
+	if (lr[y].lo > lr[y].hi)
+	    continue;
+	if (col2 >= col1) {
+	    if (!clear_span(row1 + sy * y, col1 + lr[y].lo, col1 + lr[y].hi))
+		return FALSE;
+	} else {
+	    if (!clear_span(row1 + sy * y, col1 - lr[y].hi, col1 - lr[y].lo))
+		return FALSE;
+	}
+    }
+    return TRUE;
+}
+
+
+/*
+ * Return the first column from col to stop that either row of a could see
+ * array has COULD_SEE or IN_SIGHT set on, or stop+1 if there is none.  The
+ * rows are checked 8 columns at a time.
+ */
+static int next_vis_col(const char *old_row, const char *next_row,
+			int col, int stop)
+{
+    uint64_t wo, wn;
+
+    for (; col + 8 <= stop + 1; col += 8) {
+	memcpy(&wo, old_row + col, 8);
+	memcpy(&wn, next_row + col, 8);
+	if ((wo | wn) & (0x0101010101010101ULL * (COULD_SEE|IN_SIGHT)))
+	    break;
+    }
+    for (; col <= stop; col++)
+	if ((old_row[col] | next_row[col]) & (COULD_SEE|IN_SIGHT))
+	    break;
+    return col;
+}
+
+
+/*
+ * Time the vision kernels against the code they replace, from each of the
+ * hero's recently recorded positions: clear_path() to every square of the
+ * level, and the scan vision_recalc() makes for positions whose could see
+ * state needs updating, between the could see arrays of consecutive
+ * positions.  Both versions must get the same answers.
+ */
+int wiz_vision_bench(void)
+{
+#define BENCH_ROUNDS 20
+#define BENCH_PATH 50
+    static char bench_cs[2][ROWNO][COLNO];
+    char *bench_rows[2][ROWNO], bench_rmin[2][ROWNO], bench_rmax[2][ROWNO];
+    coord path[BENCH_PATH + 1];
+    struct menulist menu;
+    char buf[BUFSZ];
+    clock_t t0, t_mask = 0, t_point = 0, t_word = 0, t_col = 0;
+    long paths = 0, cols_word = 0, cols_col = 0;
+    int npath, i, r, x, y, cur, col, start, stop, path_mismatch = 0;
+
+    npath = get_track(path, BENCH_PATH);
+    path[npath].x = u.ux;
+    path[npath].y = u.uy;
+    npath++;
+
+    for (i = 0; i < ROWNO; i++) {
+	bench_rows[0][i] = bench_cs[0][i];
+	bench_rows[1][i] = bench_cs[1][i];
+    }
+    memset(bench_cs, 0, sizeof(bench_cs));
+    memset(bench_rmin, 0, sizeof(bench_rmin));
+    memset(bench_rmax, 0, sizeof(bench_rmax));
+
+    for (i = 0; i < npath; i++) {
+	/* clear_path() to everywhere */
+	t0 = clock();
+	for (r = 0; r < BENCH_ROUNDS; r++)
+	    for (y = 0; y < ROWNO; y++)
+		for (x = 1; x < COLNO; x++)
+		    paths += clear_path(path[i].x, path[i].y, x, y);
+	t_mask += clock() - t0;
+
+	t0 = clock();
+	for (r = 0; r < BENCH_ROUNDS; r++)
+	    for (y = 0; y < ROWNO; y++)
+		for (x = 1; x < COLNO; x++)
+		    paths -= clear_path_pointwise(path[i].x, path[i].y, x, y);
+	t_point += clock() - t0;
+
+	for (y = 0; y < ROWNO; y++)
+	    for (x = 1; x < COLNO; x++)
+		if (clear_path(path[i].x, path[i].y, x, y) !=
+		    clear_path_pointwise(path[i].x, path[i].y, x, y))
+		    path_mismatch++;
+
+	/* the could see array from here, compared with the one before */
+	cur = i & 1;
+	memset(bench_cs[cur], 0, sizeof(bench_cs[cur]));
+	for (y = 0; y < ROWNO; y++) {
+	    bench_rmin[cur][y] = COLNO-1;
+	    bench_rmax[cur][y] = 0;
+	}
+	view_from(path[i].y, path[i].x, bench_rows[cur], bench_rmin[cur],
+		  bench_rmax[cur], 0, NULL, NULL);
+
+	t0 = clock();
+	for (r = 0; r < BENCH_ROUNDS; r++)
+	    for (y = 0; y < ROWNO; y++) {
+		start = min(bench_rmin[!cur][y], bench_rmin[cur][y]);
+		stop = max(bench_rmax[!cur][y], bench_rmax[cur][y]);
+		for (col = next_vis_col(bench_cs[!cur][y], bench_cs[cur][y],
+					start, stop);
+		     col <= stop;
+		     col = next_vis_col(bench_cs[!cur][y], bench_cs[cur][y],
+					col + 1, stop))
+		    cols_word++;
+	    }
+	t_word += clock() - t0;
+
+	t0 = clock();
+	for (r = 0; r < BENCH_ROUNDS; r++)
+	    for (y = 0; y < ROWNO; y++) {
+		start = min(bench_rmin[!cur][y], bench_rmin[cur][y]);
+		stop = max(bench_rmax[!cur][y], bench_rmax[cur][y]);
+		for (col = start; col <= stop; col++)
+		    if ((bench_cs[!cur][y][col] | bench_cs[cur][y][col]) &
+			(COULD_SEE|IN_SIGHT))
+			cols_col++;
+	    }
+	t_col += clock() - t0;
+    }
+
+    init_menulist(&menu);
+    sprintf(buf, "Vision kernels along %d recorded positions, %d rounds:",
+	    npath, BENCH_ROUNDS);
+    add_menutext(&menu, buf);
+    add_menutext(&menu, "");
+    sprintf(buf, "clear_path by rows:     %8.3f ms", t_mask * 1000.0 / CLOCKS_PER_SEC);
+    add_menutext(&menu, buf);
+    sprintf(buf, "clear_path by points:   %8.3f ms  (%d mismatches)",
+	    t_point * 1000.0 / CLOCKS_PER_SEC, path_mismatch + (paths != 0));
+    add_menutext(&menu, buf);
+    sprintf(buf, "update scan by words:   %8.3f ms", t_word * 1000.0 / CLOCKS_PER_SEC);
+    add_menutext(&menu, buf);
+    sprintf(buf, "update scan by columns: %8.3f ms  (%ld vs %ld positions)",
+	    t_col * 1000.0 / CLOCKS_PER_SEC, cols_word, cols_col);
+    add_menutext(&menu, buf);
+
+    display_menu(menu.items, menu.icount, NULL, PICK_NONE, NULL);
+    free(menu.items);
+
+    return 0;
+#undef BENCH_ROUNDS
+#undef BENCH_PATH
+}
+
+
 /*===========================================================================*\
 			    GENERAL LINE OF SIGHT
 				Algorithm C
@@ -0,0 +1,368 @@
+/* DynaHack may be freely redistributed.  See license for details. */
+
+/*
+ * diffbench: measure the memfile diff kernel on recorded game states.
+ *
+ * Every "~ f:" token in a game log is the diff between the save states before
+ * and after a command.  diffbench rebuilds the sequence of save states from
+ * those diffs, then diffs each state against its predecessor twice: once with
+ * mwrite() from memfile.c, and once with the original byte-at-a-time loop.
+ * It reports the time taken by each and checks that the diffs are identical.
+ *
+ * The states are fed to mwrite() in chunks of -c bytes (default 4), which
+ * approximates the mwrite8/mwrite32 calls savegame() makes.  Use -s to skip
+ * the early part of a game and only measure late-game states.
+ */
+
+#include "hack.h"
+#include <time.h>
+#include <zlib.h>
+
+struct diffbench_stats {
+    long states, bytes, mismatches;
+    clock_t ref_time, kernel_time;
+};
+
+static int chunksize = 4;
+static long skip_states;
+
+/* base 64 decoding table */
+static const char b64d[256] = {
+    /* 32 control chars */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                           0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    /* ' ' - '/' */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 62, 0, 0, 0, 63,
+    /* '0' - '9' */ 52, 53, 54, 55, 56, 57, 58, 59, 60, 61,
+    /* ':' - '@' */ 0, 0, 0, 0, 0, 0, 0,
+    /* 'A' - 'Z' */ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16,
+                    17, 18, 19, 20, 21, 22, 23, 24, 25,
+    /* '[' - '\''*/ 0, 0, 0, 0, 0, 0,
+    /* 'a' - 'z' */ 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
+                    41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51
+};
+
+
+void NORETURN terminate(void)
+{
+    exit(EXIT_FAILURE);
+}
+
+
+/* Decode a log_binary() token.  Returns a malloc'd buffer, or NULL. */
+static unsigned char *decode_binary(const char *in, int *outlen)
+{
+    int i, len, pos = 0;
+    unsigned long blen = 0;
+    unsigned char *raw, *out;
+
+    if (*in == '$') {
+	blen = atol(in + 1);
+	in = strchr(in + 1, '$');
+	if (!in)
+	    return NULL;
+	in++;
+    }
+
+    len = strlen(in);
+    raw = malloc(len / 4 * 3 + 3);
+    for (i = 0; i + 3 < len; i += 4) {
+	raw[pos++] = b64d[(int)in[i  ]] << 2 | b64d[(int)in[i+1]] >> 4;
+	if (in[i+2] != '=')
+	    raw[pos++] = b64d[(int)in[i+1]] << 4 | b64d[(int)in[i+2]] >> 2;
+	if (in[i+3] != '=')
+	    raw[pos++] = (b64d[(int)in[i+2]] << 6 & 0xc0) | b64d[(int)in[i+3]];
+    }
+
+    if (!blen) {
+	*outlen = pos;
+	return raw;
+    }
+
+    out = malloc(blen);
+    if (uncompress(out, &blen, raw, pos) != Z_OK) {
+	free(raw);
+	free(out);
+	return NULL;
+    }
+    free(raw);
+    *outlen = blen;
+    return out;
+}
+
+
+/* Build the state described by diff relative to base. */
+static char *apply_diff(const char *base, int baselen, const unsigned char *diff,
+			int difflen, int *outlen)
+{
+    int dpos = 0, bpos = 0, len = 0, size = baselen + 4096;
+    char *out = malloc(size);
+
+    while (dpos + 1 < difflen) {
+	enum mdiff_cmd cmd = diff[dpos+1] >> 6;
+	int n = ((diff[dpos+1] & 0x3f) << 8) + diff[dpos];
+	dpos += 2;
+
+	if (cmd == MDIFF_SEEK) {
+	    if (n >= 0x2000)
+		n -= 0x4000;
+	    bpos -= n;
+	    continue;
+	}
+	if (len + n > size) {
+	    size = (len + n) * 2;
+	    out = realloc(out, size);
+	}
+	if (cmd == MDIFF_COPY) {
+	    if (bpos < 0 || bpos + n > baselen) {
+		free(out);
+		return NULL;
+	    }
+	    memcpy(out + len, base + bpos, n);
+	} else {
+	    if (dpos + n > difflen) {
+		free(out);
+		return NULL;
+	    }
+	    memcpy(out + len, diff + dpos, n);
+	    dpos += n;
+	}
+	bpos += n;
+	len += n;
+    }
+
+    *outlen = len;
+    return out;
+}
+
+
+/*
+ * mwrite() as it was before it had a block-wise kernel, kept here as the
+ * reference.  Tags are not used, so no seeks are generated.
+ */
+static void ref_diffwrite(struct memfile *mf, const void *buf, unsigned int bytes)
+{
+    boolean do_realloc = FALSE;
+    while (mf->difflen < mf->diffpos + bytes) {
+	mf->difflen += 4096;
+	do_realloc = TRUE;
+    }
+
+    if (do_realloc)
+	mf->diffbuf = realloc(mf->diffbuf, mf->difflen);
+    memcpy(&mf->diffbuf[mf->diffpos], buf, bytes);
+    mf->diffpos += bytes;
+}
+
+static void ref_flush(struct memfile *mf)
+{
+    if (mf->curcmd != MDIFF_INVALID) {
+	unsigned char cmd[2];
+	cmd[0] = mf->curcount & 0xff;
+	cmd[1] = ((mf->curcount >> 8) & 0x3f) | (mf->curcmd << 6);
+	ref_diffwrite(mf, cmd, 2);
+    }
+    if (mf->curcmd == MDIFF_EDIT)
+	ref_diffwrite(mf, mf->buf + mf->pos - mf->curcount, mf->curcount);
+    mf->curcmd = MDIFF_INVALID;
+}
+
+static void ref_mwrite(struct memfile *mf, const void *buf, unsigned int num)
+{
+    boolean do_realloc = FALSE;
+    while (mf->len < mf->pos + num) {
+	mf->len += 4096;
+	do_realloc = TRUE;
+    }
+
+    if (do_realloc)
+	mf->buf = realloc(mf->buf, mf->len);
+    memcpy(&mf->buf[mf->pos], buf, num);
+
+    while (num--) {
+	if (mf->relativepos < mf->relativeto->pos &&
+	    mf->buf[mf->pos] == mf->relativeto->buf[mf->relativepos]) {
+	    if (mf->curcmd != MDIFF_COPY || mf->curcount >= 0x3fff) {
+		ref_flush(mf);
+		mf->curcount = 0;
+	    }
+	    mf->curcmd = MDIFF_COPY;
+	    mf->curcount++;
+	} else {
+	    if (mf->curcmd != MDIFF_EDIT || mf->curcount >= 0x3fff) {
+		ref_flush(mf);
+		mf->curcount = 0;
+	    }
+	    mf->curcmd = MDIFF_EDIT;
+	    mf->curcount++;
+	}
+	mf->pos++;
+	mf->relativepos++;
+    }
+}
+
+
+static clock_t time_kernel(struct memfile *mf, struct memfile *parent,
+			   const char *data, int len)
+{
+    clock_t t = clock();
+    int i;
+
+    mnew(mf, parent);
+    for (i = 0; i < len; i += chunksize)
+	mwrite(mf, data + i, min(chunksize, len - i));
+    mdiffflush(mf);
+    return clock() - t;
+}
+
+
+static clock_t time_ref(struct memfile *mf, struct memfile *parent,
+			const char *data, int len)
+{
+    clock_t t = clock();
+    int i;
+
+    mnew(mf, parent);
+    for (i = 0; i < len; i += chunksize)
+	ref_mwrite(mf, data + i, min(chunksize, len - i));
+    ref_flush(mf);
+    return clock() - t;
+}
+
+
+static void bench_pair(const char *base, int baselen, const char *data, int len,
+		       struct diffbench_stats *st)
+{
+    struct memfile parent, mf, ref;
+
+    mnew(&parent, NULL);
+    mwrite(&parent, base, baselen);
+
+    /* alternate which goes first, so neither always gets a warm cache */
+    if (st->states & 1) {
+	st->kernel_time += time_kernel(&mf, &parent, data, len);
+	st->ref_time += time_ref(&ref, &parent, data, len);
+    } else {
+	st->ref_time += time_ref(&ref, &parent, data, len);
+	st->kernel_time += time_kernel(&mf, &parent, data, len);
+    }
+
+    if (ref.diffpos != mf.diffpos || memcmp(ref.diffbuf, mf.diffbuf, ref.diffpos))
+	st->mismatches++;
+    st->states++;
+    st->bytes += len;
+
+    mfree(&ref);
+    mfree(&mf);
+    mfree(&parent);
+}
+
+
+static int bench_log(const char *filename, struct diffbench_stats *st)
+{
+    FILE *fp;
+    char *log, *tok, *state = NULL;
+    unsigned int endpos;
+    long size, nstates = 0;
+    int statelen = 0;
+    boolean next_is_diff = FALSE;
+
+    fp = fopen(filename, "rb");
+    if (!fp) {
+	fprintf(stderr, "%s: cannot open file\n", filename);
+	return FALSE;
+    }
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    log = malloc(size + 1);
+    if (fread(log, 1, size, fp) != (size_t)size) {
+	fprintf(stderr, "%s: read error\n", filename);
+	fclose(fp);
+	free(log);
+	return FALSE;
+    }
+    fclose(fp);
+    log[size] = '\0';
+
+    /* only the text part of the log; a saved game has binary data after it */
+    if (sscanf(log, "NHGAME %*4s %x", &endpos) != 1) {
+	fprintf(stderr, "%s: not a DynaHack game log\n", filename);
+	free(log);
+	return FALSE;
+    }
+    if (endpos && endpos < size)
+	log[endpos] = '\0';
+
+    for (tok = strtok(log, " \n"); tok; tok = strtok(NULL, " \n")) {
+	unsigned char *diff;
+	char *newstate;
+	int difflen, newlen;
+
+	if (!strcmp(tok, "~")) {
+	    next_is_diff = TRUE;
+	    continue;
+	}
+	if (!next_is_diff || strncmp(tok, "f:", 2))
+	    continue;
+	next_is_diff = FALSE;
+
+	diff = decode_binary(tok + 2, &difflen);
+	newstate = diff ? apply_diff(state, statelen, diff, difflen, &newlen) : NULL;
+	free(diff);
+	if (!newstate) {
+	    fprintf(stderr, "%s: bad diff after %ld states\n", filename, nstates);
+	    break;
+	}
+
+	if (state && nstates >= skip_states)
+	    bench_pair(state, statelen, newstate, newlen, st);
+	free(state);
+	state = newstate;
+	statelen = newlen;
+	nstates++;
+    }
+
+    free(state);
+    free(log);
+    return TRUE;
+}
+
+
+int main(int argc, char *argv[])
+{
+    struct diffbench_stats st;
+    int i;
+
+    memset(&st, 0, sizeof(st));
+    for (i = 1; i < argc; i++) {
+	if (!strcmp(argv[i], "-c") && i + 1 < argc) {
+	    chunksize = atoi(argv[++i]);
+	    if (chunksize < 1)
+		chunksize = 1;
+	} else if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+	    skip_states = atol(argv[++i]);
+	} else if (argv[i][0] == '-') {
+	    fprintf(stderr, "Usage: %s [-c chunksize] [-s skipstates] logfile...\n",
+		    argv[0]);
+	    return EXIT_FAILURE;
+	} else {
+	    bench_log(argv[i], &st);
+	}
+    }
+
+    if (!st.states) {
+	printf("no states to compare\n");
+	return EXIT_FAILURE;
+    }
+
+    printf("%ld states, %.1f MB diffed in chunks of %d bytes\n", st.states,
+	   st.bytes / 1048576.0, chunksize);
+    printf("byte loop: %8.3f s\n", (double)st.ref_time / CLOCKS_PER_SEC);
+    printf("kernel:    %8.3f s", (double)st.kernel_time / CLOCKS_PER_SEC);
+    if (st.kernel_time)
+	printf("  (%.2fx)", (double)st.ref_time / st.kernel_time);
+    printf("\n%ld mismatched diffs\n", st.mismatches);
+
+    return st.mismatches ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/*diffbench.c*/
@@ -0,0 +1,417 @@
+/* DynaHack may be freely redistributed.  See license for details. */
+
+/*
+ * logverify: replay many game logs and report where they desync.
+ *
+ * Each log is replayed one action at a time in its own forked process, so
+ * every action's recorded save is compared against the save the replay
+ * produces (replay_check_diff), and the game state of one log can never leak
+ * into another.  Up to -j logs are verified at once; the default is one per
+ * online CPU.  A child that runs longer than -t seconds is killed.
+ *
+ * The output is one tab-separated line per log:
+ *     file  status  action  actions  moves  seconds  message
+ * where status is one of ok, desync, panic, invalid or killed, action is the
+ * action at which the first problem was reported (0 if none), actions is
+ * replayed/recorded and message is the first message the library printed.
+ * A "# summary" line with the totals and the throughput comes last.  The exit
+ * status is non-zero if any log failed to verify.
+ *
+ * The library needs its data files; use -d or $DYNAHACKDIR to point at them.
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#include "nitrohack.h"
+
+#define MSGLEN 256
+
+enum verify_status {
+    VS_OK,
+    VS_DESYNC,
+    VS_PANIC,
+    VS_INVALID,
+    VS_KILLED
+};
+
+static const char *const status_names[] = {
+    "ok", "desync", "panic", "invalid", "killed"
+};
+
+/* sent from a worker to the parent through a pipe */
+struct verify_result {
+    enum verify_status status;
+    int action;		/* action at which the first problem was reported */
+    int actions, max_actions, moves;
+    double seconds;
+    char msg[MSGLEN];
+};
+
+struct verify_job {
+    const char *file;
+    pid_t pid;
+    int pipefd;
+    struct timeval start;
+};
+
+/* messages that mean the replay and the recording disagree */
+static const char *const desync_msgs[] = {
+    "desync between recording",
+    "The recorded commands seem to be invalid",
+    "The diffs in the recording seem to be invalid",
+    "Error at file position",
+    "Unexpected EOF or error in save file",
+    "Decompressing save file failed",
+    NULL
+};
+
+/* the first line panic() prints */
+static const char *const panic_msgs[] = {
+    "Suddenly, the dungeon collapses",
+    "Program initialization has failed",
+    "Postgame wrapup disrupted",
+    NULL
+};
+
+static struct verify_result result;
+static int current_action;
+static int timeout = 600;
+
+
+static double elapsed(const struct timeval *start)
+{
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return (now.tv_sec - start->tv_sec) + (now.tv_usec - start->tv_usec) / 1e6;
+}
+
+
+static int match_msg(const char *const *list, const char *str)
+{
+    int i;
+    for (i = 0; list[i]; i++)
+	if (!strncmp(str, list[i], strlen(list[i])))
+	    return TRUE;
+    return FALSE;
+}
+
+
+/*
+ * Every message the library has for us arrives here; the first one is kept
+ * for the report, and the first problem determines the status.
+ */
+static void verify_raw_print(const char *str)
+{
+    enum verify_status status = VS_OK;
+    char *nl;
+
+    if (match_msg(desync_msgs, str))
+	status = VS_DESYNC;
+    else if (match_msg(panic_msgs, str))
+	status = VS_PANIC;
+
+    if (!result.msg[0] || (status != VS_OK && result.status == VS_OK)) {
+	strncpy(result.msg, str, MSGLEN - 1);
+	result.msg[MSGLEN - 1] = '\0';
+	/* keep the output one line per log */
+	while ((nl = strpbrk(result.msg, "\t\n")))
+	    *nl = ' ';
+    }
+    if (status != VS_OK && result.status == VS_OK) {
+	result.status = status;
+	result.action = current_action;
+    }
+}
+
+
+/* nothing is displayed: all the other window procs do nothing */
+static void verify_pause(enum nh_pause_reason reason) {}
+static void verify_display_buffer(const char *buf, nh_bool trymove) {}
+static void verify_update_status(struct nh_player_info *pi) {}
+static void verify_print_message(int turn, const char *msg) {}
+static int verify_display_menu(struct nh_menuitem *items, int icount,
+			       const char *title, int how, int *results)
+{
+    return -1;
+}
+static int verify_display_objects(struct nh_objitem *items, int icount,
+				  const char *title, int how,
+				  struct nh_objresult *pick_list)
+{
+    return -1;
+}
+static nh_bool verify_list_items(struct nh_objitem *items, int icount,
+				 nh_bool invent)
+{
+    return FALSE;
+}
+static void verify_update_screen(struct nh_dbuf_entry dbuf[ROWNO][COLNO],
+				 int ux, int uy) {}
+static char verify_query_key(const char *query, int *count)
+{
+    return '\033';
+}
+static int verify_getpos(int *x, int *y, nh_bool force, const char *goal)
+{
+    return -1;
+}
+static enum nh_direction verify_getdir(const char *query, nh_bool restricted)
+{
+    return DIR_NONE;
+}
+static char verify_yn_function(const char *query, const char *rset,
+			       char defchoice)
+{
+    return defchoice;
+}
+static void verify_getlin(const char *query, char *buf)
+{
+    strcpy(buf, "\033");
+}
+static void verify_delay(void) {}
+static void verify_level_changed(int displaymode) {}
+static void verify_outrip(struct nh_menuitem *items, int icount,
+			  nh_bool tombstone, const char *name, int gold,
+			  const char *killbuf, int end_how, int year) {}
+
+static struct nh_window_procs verify_windowprocs = {
+    verify_pause,
+    verify_display_buffer,
+    verify_update_status,
+    verify_print_message,
+    verify_display_menu,
+    verify_display_objects,
+    verify_list_items,
+    verify_update_screen,
+    verify_raw_print,
+    verify_query_key,
+    verify_getpos,
+    verify_getdir,
+    verify_yn_function,
+    verify_getlin,
+    verify_delay,
+    verify_level_changed,
+    verify_outrip,
+    verify_print_message,
+};
+
+
+/* Runs in a worker process: replay one log and fill in result. */
+static void verify_log(const char *file)
+{
+    struct nh_replay_info info;
+    struct timeval start;
+    int fd, prev;
+
+    memset(&result, 0, sizeof(result));
+    gettimeofday(&start, NULL);
+
+    /* nh_get_savegame_status() needs a write lock, so open the log rw */
+    fd = open(file, O_RDWR);
+    if (fd == -1) {
+	result.status = VS_INVALID;
+	snprintf(result.msg, MSGLEN, "%s", strerror(errno));
+	return;
+    }
+
+    if (!nh_view_replay_start(fd, &verify_windowprocs, &info)) {
+	result.status = VS_INVALID;
+	if (!result.msg[0])
+	    strcpy(result.msg, "not a valid game log");
+	close(fd);
+	result.seconds = elapsed(&start);
+	return;
+    }
+    result.max_actions = info.max_actions;
+
+    while (info.actions < info.max_actions) {
+	prev = info.actions;
+	current_action = info.actions + 1;
+	if (!nh_view_replay_step(&info, REPLAY_FORWARD, 1) ||
+	    info.actions <= prev)
+	    break;
+	result.actions = info.actions;
+	result.moves = info.moves;
+    }
+
+    nh_view_replay_finish();
+    close(fd);
+
+    if (result.status == VS_OK && result.actions < result.max_actions) {
+	result.status = VS_DESYNC;
+	result.action = result.actions + 1;
+	if (!result.msg[0])
+	    strcpy(result.msg, "replay stopped early");
+    }
+    result.seconds = elapsed(&start);
+}
+
+
+static void start_job(struct verify_job *job, const char *file)
+{
+    int fds[2];
+
+    job->file = file;
+    gettimeofday(&job->start, NULL);
+    if (pipe(fds) == -1) {
+	perror("pipe");
+	exit(EXIT_FAILURE);
+    }
+
+    job->pid = fork();
+    if (job->pid == -1) {
+	perror("fork");
+	exit(EXIT_FAILURE);
+    }
+    if (job->pid == 0) {
+	close(fds[0]);
+	alarm(timeout);
+	verify_log(file);
+	/* a verify_result is smaller than PIPE_BUF, so this can't block */
+	if (write(fds[1], &result, sizeof(result)) != sizeof(result))
+	    _exit(EXIT_FAILURE);
+	_exit(EXIT_SUCCESS);
+    }
+
+    close(fds[1]);
+    job->pipefd = fds[0];
+}
+
+
+static void finish_job(struct verify_job *job, int wstatus,
+		       struct verify_result *res)
+{
+    memset(res, 0, sizeof(*res));
+    if (read(job->pipefd, res, sizeof(*res)) != sizeof(*res)) {
+	memset(res, 0, sizeof(*res));
+	res->status = VS_KILLED;
+	if (WIFSIGNALED(wstatus))
+	    snprintf(res->msg, MSGLEN, "killed by signal %d%s",
+		     WTERMSIG(wstatus),
+		     WTERMSIG(wstatus) == SIGALRM ? " (timeout)" : "");
+	else
+	    snprintf(res->msg, MSGLEN, "exited with status %d",
+		     WEXITSTATUS(wstatus));
+	res->seconds = elapsed(&job->start);
+    }
+    close(job->pipefd);
+    job->pid = 0;
+}
+
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr, "Usage: %s [-j jobs] [-t timeout] [-d datadir] logfile...\n",
+	    argv0);
+    exit(EXIT_FAILURE);
+}
+
+
+int main(int argc, char *argv[])
+{
+    char *paths[PREFIX_COUNT];
+    char *datadir = getenv("DYNAHACKDIR");
+    struct verify_job *jobs;
+    struct verify_result res;
+    struct timeval start;
+    long total_actions = 0;
+    int counts[VS_KILLED + 1];
+    int njobs = 0, running = 0, i, wstatus;
+    int nfiles = 0, next = 0;
+    const char **files;
+    double seconds;
+    pid_t pid;
+
+    files = malloc(argc * sizeof(char*));
+    for (i = 1; i < argc; i++) {
+	if (!strcmp(argv[i], "-j") && i + 1 < argc)
+	    njobs = atoi(argv[++i]);
+	else if (!strcmp(argv[i], "-t") && i + 1 < argc)
+	    timeout = atoi(argv[++i]);
+	else if (!strcmp(argv[i], "-d") && i + 1 < argc)
+	    datadir = argv[++i];
+	else if (argv[i][0] == '-')
+	    usage(argv[0]);
+	else
+	    files[nfiles++] = argv[i];
+    }
+    if (!nfiles)
+	usage(argv[0]);
+    if (!datadir) {
+	fprintf(stderr, "%s: set DYNAHACKDIR or use -d to locate the game data\n",
+		argv[0]);
+	return EXIT_FAILURE;
+    }
+    if (njobs < 1)
+	njobs = sysconf(_SC_NPROCESSORS_ONLN);
+    if (njobs < 1)
+	njobs = 1;
+    if (njobs > nfiles)
+	njobs = nfiles;
+
+    /* initialize once; every worker starts from a copy of this state */
+    for (i = 0; i < PREFIX_COUNT; i++)
+	paths[i] = datadir;
+    nh_lib_init(&verify_windowprocs, paths);
+
+    jobs = calloc(njobs, sizeof(struct verify_job));
+    memset(counts, 0, sizeof(counts));
+    gettimeofday(&start, NULL);
+    printf("#file\tstatus\taction\tactions\tmoves\tseconds\tmessage\n");
+
+    while (next < nfiles || running) {
+	for (i = 0; i < njobs && next < nfiles; i++) {
+	    if (jobs[i].pid)
+		continue;
+	    fflush(stdout); /* don't duplicate buffered output in the child */
+	    start_job(&jobs[i], files[next++]);
+	    running++;
+	}
+
+	pid = wait(&wstatus);
+	if (pid == -1) {
+	    if (errno == EINTR)
+		continue;
+	    perror("wait");
+	    return EXIT_FAILURE;
+	}
+	for (i = 0; i < njobs; i++)
+	    if (jobs[i].pid == pid)
+		break;
+	if (i == njobs)
+	    continue;
+
+	finish_job(&jobs[i], wstatus, &res);
+	running--;
+	counts[res.status]++;
+	total_actions += res.actions;
+	printf("%s\t%s\t%d\t%d/%d\t%d\t%.2f\t%s\n", jobs[i].file,
+	       status_names[res.status], res.action, res.actions,
+	       res.max_actions, res.moves, res.seconds, res.msg);
+	fflush(stdout);
+    }
+
+    seconds = elapsed(&start);
+    printf("# summary\tgames=%d\tok=%d\tdesync=%d\tpanic=%d\tinvalid=%d"
+	   "\tkilled=%d\tactions=%ld\tjobs=%d\tseconds=%.2f\tgames_per_sec=%.2f"
+	   "\tactions_per_sec=%.0f\n", nfiles, counts[VS_OK], counts[VS_DESYNC],
+	   counts[VS_PANIC], counts[VS_INVALID], counts[VS_KILLED],
+	   total_actions, njobs, seconds, seconds > 0 ? nfiles / seconds : 0.0,
+	   seconds > 0 ? total_actions / seconds : 0.0);
+
+    nh_lib_exit();
+    free(jobs);
+    free(files);
+    return counts[VS_OK] == nfiles ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*logverify.c*/
@@ -347,9 +347,10 @@ static int connect_server(const char *host, int port, int want_v4, char *errmsg,
 static int do_connect(const char *host, int port, const char *user, const char *pass,
 		      const char *email, int reg_user, int connid)
 {
-    int fd = -1, authresult;
+    int fd = -1, authresult, dbuf_bin = FALSE;
     char ipv6_error[120], ipv4_error[120], errmsg[256];
     json_t *jmsg, *jarr;
+    unsigned int i;
     
 #ifdef UNIX
     /* try to connect to a local unix socket */
@@ -426,8 +427,26 @@ static int do_connect(const char *host, int port, const char *user, const char *
 	nhnet_server_ver.minor = json_integer_value(json_array_get(jarr, 1));
 	nhnet_server_ver.patchlevel = json_integer_value(json_array_get(jarr, 2));
     }
+    /* so is the list of optional protocol features */
+    if (json_unpack(jmsg, "{so*}", "features", &jarr) != -1 && json_is_array(jarr))
+	for (i = 0; i < json_array_size(jarr); i++)
+	    if (json_is_string(json_array_get(jarr, i)) &&
+		!strcmp(json_string_value(json_array_get(jarr, i)),
+			NHNET_FEATURE_DBUF_BIN))
+		dbuf_bin = TRUE;
     json_decref(jmsg);
     
+    if (dbuf_bin && (authresult == AUTH_SUCCESS_NEW ||
+		     authresult == AUTH_SUCCESS_RECONNECT)) {
+	in_connect_disconnect = TRUE;
+	jmsg = send_receive_msg("set_features",
+				json_pack("{si}", NHNET_FEATURE_DBUF_BIN, 1));
+	in_connect_disconnect = FALSE;
+	if (!jmsg)
+	    return NO_CONNECTION;
+	json_decref(jmsg);
+    }
+    
     if (host != saved_hostname)
 	strncpy(saved_hostname, host, sizeof(saved_hostname));
     if (user != saved_username)
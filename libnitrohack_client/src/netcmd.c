@@ -5,6 +5,7 @@
  */
 
 #include "nhclient.h"
+#include <zlib.h>
 
 struct netcmd {
     const char *name;
@@ -301,6 +302,115 @@ static json_t *cmd_print_message_nonblocking(json_t *params, int display_only)
 }
 
 
+static int base64_decode(const char *in, unsigned char *out, int outsize)
+{
+    static signed char val[256];
+    static const char b64[] =
+	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    unsigned int v = 0;
+    int i, bits = 0, len = 0;
+    
+    if (!val['B']) {
+	memset(val, -1, sizeof(val));
+	for (i = 0; i < 64; i++)
+	    val[(unsigned char)b64[i]] = i;
+    }
+    
+    for (; *in && *in != '='; in++) {
+	if (val[(unsigned char)*in] < 0)
+	    return -1;
+	v = (v << 6) | val[(unsigned char)*in];
+	bits += 6;
+	if (bits >= 8) {
+	    bits -= 8;
+	    if (len == outsize)
+		return -1;
+	    out[len++] = (v >> bits) & 0xff;
+	}
+    }
+    return len;
+}
+
+
+/*
+ * Apply a compact map update (see nitrohack_client.h) to dbuf. All the
+ * decoding happens in static buffers.
+ */
+static int decode_dbuf_bin(const char *str, struct nh_dbuf_entry dbuf[ROWNO][COLNO])
+{
+    static unsigned char msg[DBUF_BIN_HEADER_LEN + DBUF_BIN_PAYLOAD_MAX + 64];
+    static unsigned char payload[DBUF_BIN_PAYLOAD_MAX];
+    const unsigned char *data, *p, *end;
+    struct nh_dbuf_entry *dbe;
+    uLongf zlen;
+    int i, len, plen, mask;
+    
+    len = base64_decode(str, msg, sizeof(msg));
+    if (len < DBUF_BIN_HEADER_LEN)
+	return FALSE;
+    plen = msg[1] | (msg[2] << 8);
+    if (plen < DBUF_BIN_MASK_LEN || plen > DBUF_BIN_PAYLOAD_MAX)
+	return FALSE;
+    
+    if (msg[0] & DBUF_BIN_ZLIB) {
+	zlen = plen;
+	if (uncompress(payload, &zlen, msg + DBUF_BIN_HEADER_LEN,
+		       len - DBUF_BIN_HEADER_LEN) != Z_OK || zlen != plen)
+	    return FALSE;
+	data = payload;
+    } else {
+	if (len - DBUF_BIN_HEADER_LEN != plen)
+	    return FALSE;
+	data = msg + DBUF_BIN_HEADER_LEN;
+    }
+    
+    if (msg[0] & DBUF_BIN_KEYFRAME)
+	memset(dbuf, 0, sizeof(struct nh_dbuf_entry) * ROWNO * COLNO);
+    
+#define GET16(dst) (dst = (short)(p[0] | (p[1] << 8)), p += 2)
+#define UNPACK16(field, bit) \
+    if (mask & (bit)) { if (p + 2 > end) return FALSE; GET16(dbe->field); }
+    
+    p = data + DBUF_BIN_MASK_LEN;
+    end = data + plen;
+    for (i = 0; i < ROWNO * COLNO; i++) {
+	if (!(data[i >> 3] & (1 << (i & 7))))
+	    continue;
+	
+	dbe = &dbuf[i / COLNO][i % COLNO];
+	if (p + 2 > end)
+	    return FALSE;
+	mask = p[0] | (p[1] << 8);
+	p += 2;
+	
+	if (mask & DBUF_BIN_F_EFFECT) {
+	    if (p + 4 > end)
+		return FALSE;
+	    dbe->effect = p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned)p[3] << 24);
+	    p += 4;
+	}
+	UNPACK16(bg, DBUF_BIN_F_BG)
+	UNPACK16(trap, DBUF_BIN_F_TRAP)
+	UNPACK16(obj, DBUF_BIN_F_OBJ)
+	UNPACK16(obj_mn, DBUF_BIN_F_OBJ_MN)
+	UNPACK16(objflags, DBUF_BIN_F_OBJFLAGS)
+	UNPACK16(mon, DBUF_BIN_F_MON)
+	UNPACK16(monflags, DBUF_BIN_F_MONFLAGS)
+	if (mask & DBUF_BIN_F_INVIS) {
+	    if (p + 1 > end)
+		return FALSE;
+	    dbe->invis = *p++;
+	}
+	UNPACK16(dgnflags, DBUF_BIN_F_DGNFLAGS)
+    }
+    
+#undef UNPACK16
+#undef GET16
+    
+    return p == end;
+}
+
+
 static json_t *cmd_update_screen(json_t *params, int display_only)
 {
     static struct nh_dbuf_entry dbuf[ROWNO][COLNO];
@@ -308,6 +418,15 @@ static json_t *cmd_update_screen(json_t *params, int display_only)
     int x, y, effect, bg, trap, obj, obj_mn, objflags,
 	mon, monflags, invis, dgnflags;
     json_t *jdbuf, *col, *elem;
+    const char *binstr;
+    
+    if (json_unpack(params, "{si,si,ss!}", "ux", &ux, "uy", &uy,
+		    "dbuf_bin", &binstr) != -1) {
+	if (!decode_dbuf_bin(binstr, dbuf))
+	    print_error("Damaged map data in cmd_update_screen");
+	cur_wndprocs.win_update_screen(dbuf, ux, uy);
+	return NULL;
+    }
     
     if (json_unpack(params, "{si,si,so!}", "ux", &ux, "uy", &uy, "dbuf", &jdbuf) == -1) {
 	print_error("Incorrect parameters in cmd_update_screen");
@@ -278,7 +278,7 @@ void replay(void)
     char buf[BUFSZ];
     fnchar logdir[BUFSZ], savedir[BUFSZ], filename[1024], *dir, **files;
     struct nh_menuitem *items;
-    int i, n, fd, icount, size, filecount, pick[1];
+    int i, n, fd, idxfd, icount, size, filecount, pick[1];
     enum nh_log_status status;
     struct nh_game_info gi;
     
@@ -363,6 +363,18 @@ void replay(void)
     }
     
     fd = sys_open(filename, O_RDWR, 0660);
+    
+    /* completed games don't change any more, so the checkpoints made while
+     * viewing one can be kept in a file next to it for next time */
+    idxfd = -1;
+    if (dir == logdir) {
+	fnncat(filename, FN(".cpidx"), sizeof(filename)/sizeof(fnchar) - 1);
+	idxfd = sys_open(filename, O_RDWR | O_CREAT, 0660);
+	nh_view_replay_set_index(idxfd);
+    }
+    
     replay_commandloop(fd);
     close(fd);
+    if (idxfd != -1)
+	close(idxfd);
 }
@@ -42,6 +42,14 @@
 # define DEFAULT_CLIENT_TIMEOUT (15 * 60) /* 15 minutes */
 #endif
 
+#if !defined(DEFAULT_ZYGOTE_SPARES)
+# define DEFAULT_ZYGOTE_SPARES 2
+#endif
+
+#if !defined(DEFAULT_DB_UPDATE_INTERVAL)
+# define DEFAULT_DB_UPDATE_INTERVAL 5 /* seconds */
+#endif
+
 
 struct settings {
     char *logfile;
@@ -56,6 +64,12 @@ struct settings {
     char disable_ipv4;
     char disable_ipv6;
     char *dbhost, *dbname, *dbport, *dbuser, *dbpass;
+    int db_update_interval; /* seconds between per-command db updates */
+    int log_compression; /* zlib level for game logs; 0: library default */
+    char sync_gamelog;
+    int gamelog_header_interval; /* commands between log header updates */
+    char zygote; /* fork game processes from a preloaded template process */
+    int zygote_spares; /* game processes the zygote keeps ready */
 };
 #define SUN_PATH_MAX (sizeof(settings.bind_addr_unix.sun_path))
 
@@ -77,6 +91,7 @@ struct gamefile_info {
     int gid;
     const char *filename;
     const char *username;
+    struct nh_game_info gi; /* as recorded in the database */
 };
 
 
@@ -98,6 +113,8 @@ extern int auth_user(char *authbuf, const char *peername, int *is_reg, int *reco
 extern void auth_send_result(int sockfd, enum authresult, int is_reg, int connid);
 
 /* clientmain.c */
+extern int client_preload(void);
+extern int client_preconnect(void);
 extern void client_main(int userid, int infd, int outfd);
 extern void exit_client(const char *err);
 extern void client_msg(const char *key, json_t *value);
@@ -113,6 +130,8 @@ extern int parse_ip_addr(const char *str, struct sockaddr *out, int want_v4);
 extern int init_database(void);
 extern int check_database(void);
 extern void close_database(void);
+extern void db_flush_updates(void);
+extern int db_update_timeout(void);
 extern int db_auth_user(const char *name, const char *pass);
 extern int db_register_user(const char *name, const char *pass, const char*email);
 extern int db_get_user_info(int uid, struct user_info *info);
@@ -122,7 +141,8 @@ extern int db_set_user_password(int uid, const char *password);
 extern long db_add_new_game(int uid, const char *filename, const char *role,
 			    const char *race, const char *gend, const char *align,
 			    int mode, const char *plname, const char *levdesc);
-extern void db_update_game(int gameid, int moves, int depth, const char *levdesc);
+extern void db_update_game(int gameid, int moves, int depth, const char *levdesc,
+			   int has_amulet);
 extern int db_get_game_filename(int uid, int gid, char *namebuf, int buflen);
 extern void db_delete_game(int uid, int gid);
 extern struct gamefile_info *db_list_games(int completed, int uid, int limit, int *count);
@@ -155,6 +175,7 @@ extern int runserver(void);
 /* winprocs.c */
 extern json_t *get_display_data(void);
 extern void reset_cached_diplaydata(void);
+extern void srv_set_dbuf_encoding(int binary);
 extern void srv_display_buffer(const char *buf, nh_bool trymove);
 extern char srv_yn_function(const char *query, const char *rset, char defchoice);
 
@@ -28,6 +28,7 @@ static void ccmd_get_pl_prompt(json_t *params);
 static void ccmd_get_root_pl_prompt(json_t *params);
 static void ccmd_set_email(json_t *params);
 static void ccmd_set_password(json_t *params);
+static void ccmd_set_features(json_t *params);
 
 const struct client_command clientcmd[] = {
     {"shutdown",	ccmd_shutdown},
@@ -56,10 +57,28 @@ const struct client_command clientcmd[] = {
     
     {"set_email",	ccmd_set_email},
     {"set_password",	ccmd_set_password},
+    {"set_features",	ccmd_set_features},
     
     {NULL, NULL}
 };
 
+/* checkpoint index of the completed game that is being viewed */
+static int replay_index_fd = -1;
+
+
+/* the database record of the current game, as last written */
+static struct nh_game_info game_record;
+
+
+/* Keep the database record of the current game up to date, so that
+ * ccmd_list_games can describe the game without loading its save. */
+static void update_game_record(void)
+{
+    if (gameid && nh_get_game_info(&game_record))
+	db_update_game(gameid, game_record.moves, game_record.depth,
+		       game_record.level_desc, game_record.has_amulet);
+}
+
 
 /* shutdown: The client is done and the server process is no longer needed. */
 static void ccmd_shutdown(json_t *ignored)
@@ -113,6 +132,7 @@ static void ccmd_start_game(json_t *params)
 				 ri->racenames[race], ri->gendnames[gend],
 				 ri->alignnames[align], mode, name,
 				 player_info.levdesc_dlvl);
+	update_game_record();
 	log_msg("%s has started a new game (%d) as %s",
 		user_info.username, gameid, name);
 	j_msg = json_pack("{si,si}", "return", ret, "gameid", gameid);
@@ -164,7 +184,7 @@ static void ccmd_restore_game(json_t *params)
     if (status == GAME_RESTORED) {
 	gameid = gid;
 	gamefd = fd;
-	db_update_game(gameid, player_info.moves, player_info.z, player_info.levdesc_dlvl);
+	update_game_record();
 	log_msg("%s has restored game %d", user_info.username, gameid);
     }
 }
@@ -179,7 +199,7 @@ static void ccmd_exit_game(json_t *params)
     
     status = nh_exit_game(etype);
     if (status) {
-	db_update_game(gameid, player_info.moves, player_info.z, player_info.levdesc_dlvl);
+	update_game_record();
 	log_msg("%s has closed game %d", user_info.username, gameid);
 	gameid = 0;
 	close(gamefd);
@@ -240,7 +260,7 @@ static void ccmd_game_command(json_t *params)
     }
     
     client_msg("game_command", json_pack("{si}", "return", result));
-    db_update_game(gameid, player_info.moves, player_info.z, player_info.levdesc_dlvl);
+    update_game_record();
     
     /* move the finished game to its final resting place */
     if (result == GAME_OVER) {
@@ -257,6 +277,10 @@ static void ccmd_game_command(json_t *params)
 		 user_info.username, basename);
 	snprintf(final_name, 1024, "%s/completed/%s", settings.workdir, basename);
 	rename(filename, final_name);
+	/* The game is no longer running, so the last command's moves could
+	 * not be recorded above.  Completed games list their deepest level. */
+	db_update_game(gid, tte->moves, tte->maxlvl, game_record.level_desc,
+		       game_record.has_amulet);
 	db_add_topten_entry(gid, tte->points, tte->hp, tte->maxhp, tte->deaths,
 			    tte->end_how, tte->death, tte->entrytxt);
     }
@@ -286,6 +310,14 @@ static void ccmd_view_start(json_t *params)
     if (fd == -1) {
 	snprintf(filename, 1024, "%s/completed/%s", settings.workdir, basename);
 	fd = open(filename, O_RDWR);
+	
+	/* completed games don't change, so checkpoints made while viewing
+	 * one are kept for the next viewer */
+	if (fd != -1) {
+	    strncat(filename, ".cpidx", 1023 - strlen(filename));
+	    replay_index_fd = open(filename, O_RDWR | O_CREAT, 0644);
+	    nh_view_replay_set_index(replay_index_fd);
+	}
     }
     if (fd == -1) {
 	log_msg("failed to open game %d (file %s) for viewing", gid, basename);
@@ -295,6 +327,12 @@ static void ccmd_view_start(json_t *params)
     }
 
     ret = nh_view_replay_start(fd, &server_alt_windowprocs, &info);
+    if (!ret && replay_index_fd != -1) {
+	/* there won't be a view_finish to release the index */
+	nh_view_replay_set_index(-1);
+	close(replay_index_fd);
+	replay_index_fd = -1;
+    }
     
     jmsg = json_pack("{si,s:{ss,si,si,si,si}}", "return", ret, "info", "nextcmd",
 		     info.nextcmd, "actions", info.actions, "max_actions",
@@ -334,6 +372,9 @@ static void ccmd_view_finish(json_t *params)
 	exit_client("non-empty parameter list for view_finish");
     
     nh_view_replay_finish();
+    if (replay_index_fd != -1)
+	close(replay_index_fd);
+    replay_index_fd = -1;
     
     client_msg("view_finish", json_object());
 }
@@ -345,7 +386,7 @@ static void ccmd_list_games(json_t *params)
     int completed, limit, show_all, count, i, fd;
     struct gamefile_info *files;
     enum nh_log_status status;
-    struct nh_game_info gi;
+    struct nh_game_info *gi;
     json_t *jarr, *jobj;
     
     if (json_unpack(params, "{si,si*}", "completed", &completed, "limit", &limit) == -1)
@@ -353,44 +394,48 @@ static void ccmd_list_games(json_t *params)
     if (json_unpack(params, "{si*}", "show_all", &show_all) == -1)
 	show_all = 0;
     
-    /* step 1: get a list of files from the db. */
+    /* step 1: get a list of games and their descriptions from the db. */
     files = db_list_games(completed, show_all ? 0 : user_info.uid, limit, &count);
     
     jarr = json_array();
-    /* step 2: get extra info for each file. */
+    /* step 2: get the status of each game.  Completed games can't change; for
+     * the others only the log header and lock are checked: without an
+     * nh_game_info, nh_get_savegame_status doesn't load the save. */
     for (i = 0; i < count; i++) {
+	gi = &files[i].gi;
 	if (completed)
-	    snprintf(filename, 1024, "%s/completed/%s", settings.workdir, files[i].filename);
-	else
+	    status = LS_DONE;
+	else {
 	    snprintf(filename, 1024, "%s/save/%s/%s", settings.workdir,
 		     user_info.username, files[i].filename);
-	fd = open(filename, O_RDWR);
-	if (fd == -1) {
-	    log_msg("Game file %s could not be opened in ccmd_list_games.", files[i].filename);
-	    continue;
+	    fd = open(filename, O_RDWR);
+	    if (fd == -1) {
+		log_msg("Game file %s could not be opened in ccmd_list_games.", files[i].filename);
+		goto next;
+	    }
+	    status = nh_get_savegame_status(fd, NULL);
+	    close(fd);
 	}
 	
-	status = nh_get_savegame_status(fd, &gi);
 	jobj = json_pack("{si,si,si,ss,ss,ss,ss,ss}", "gameid", files[i].gid,
-			 "status", status, "playmode", gi.playmode,
-			 "plname", gi.name, "plrole", gi.plrole, "plrace", gi.plrace,
-			 "plgend", gi.plgend, "plalign", gi.plalign);
+			 "status", status, "playmode", gi->playmode,
+			 "plname", gi->name, "plrole", gi->plrole, "plrace", gi->plrace,
+			 "plgend", gi->plgend, "plalign", gi->plalign);
 	if (status == LS_SAVED) {
-	    json_object_set_new(jobj, "level_desc", json_string(gi.level_desc));
-	    json_object_set_new(jobj, "moves", json_integer(gi.moves));
-	    json_object_set_new(jobj, "depth", json_integer(gi.depth));
-	    json_object_set_new(jobj, "has_amulet", json_integer(gi.has_amulet));
+	    json_object_set_new(jobj, "level_desc", json_string(gi->level_desc));
+	    json_object_set_new(jobj, "moves", json_integer(gi->moves));
+	    json_object_set_new(jobj, "depth", json_integer(gi->depth));
+	    json_object_set_new(jobj, "has_amulet", json_integer(gi->has_amulet));
 	} else if (status == LS_DONE) {
-	    json_object_set_new(jobj, "death", json_string(gi.death));
-	    json_object_set_new(jobj, "moves", json_integer(gi.moves));
-	    json_object_set_new(jobj, "depth", json_integer(gi.depth));
+	    json_object_set_new(jobj, "death", json_string(gi->death));
+	    json_object_set_new(jobj, "moves", json_integer(gi->moves));
+	    json_object_set_new(jobj, "depth", json_integer(gi->depth));
 	}
 	json_array_append_new(jarr, jobj);
 	
+next:
 	free((void*)files[i].username);
 	free((void*)files[i].filename);
-	
-	close(fd);
     }
     free(files);
     
@@ -907,4 +952,21 @@ void ccmd_set_password(json_t *params)
     client_msg("set_password", json_pack("{si}", "return", ret));
 }
 
+/* set_features: switch optional protocol features; the reply lists the
+ * features that are now active. */
+void ccmd_set_features(json_t *params)
+{
+    json_t *jval;
+    int dbuf_bin;
+    
+    if (!json_is_object(params))
+	exit_client("Bad set of parameters for set_features");
+    
+    jval = json_object_get(params, NHNET_FEATURE_DBUF_BIN);
+    dbuf_bin = jval && json_is_integer(jval) && json_integer_value(jval);
+    
+    srv_set_dbuf_encoding(dbuf_bin);
+    client_msg("set_features", json_pack("{si}", NHNET_FEATURE_DBUF_BIN, dbuf_bin));
+}
+
 /* clientcmd.c */
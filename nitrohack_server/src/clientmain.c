@@ -7,6 +7,7 @@
 #include "nhserver.h"
 #include <poll.h>
 #include <ctype.h>
+#include <time.h>
 
 #define COMMBUF_SIZE (1024 * 1024)
 
@@ -16,6 +17,7 @@ int gamefd;
 long gameid; /* id in the database */
 struct user_info user_info;
 int can_send_msg;
+static int lib_ready, db_ready; /* done ahead of time in a zygote's processes */
 
 
 static char** init_game_paths(void)
@@ -55,6 +57,43 @@ static char** init_game_paths(void)
 }
 
 
+static void init_game_lib(void)
+{
+    char **gamepaths;
+    int i;
+    
+    gamepaths = init_game_paths();
+    nh_lib_init(&server_windowprocs, gamepaths);
+    nh_configure_log(settings.log_compression ? settings.log_compression : -1,
+		     !settings.sync_gamelog, settings.gamelog_header_interval);
+    for (i = 0; i < PREFIX_COUNT; i++)
+	free(gamepaths[i]);
+    free(gamepaths);
+    lib_ready = TRUE;
+}
+
+
+/*
+ * Set up the game library and load its data files in the zygote, so that the
+ * game processes forked from it start with all of that done already.
+ */
+int client_preload(void)
+{
+    init_game_lib();
+    return nh_preload_data();
+}
+
+
+/*
+ * Connect to the database in a spare game process that waits for a user.
+ */
+int client_preconnect(void)
+{
+    db_ready = init_database();
+    return db_ready;
+}
+
+
 void client_msg(const char *key, json_t *value)
 {
     int len, ret, pos;
@@ -138,7 +177,8 @@ void exit_client(const char *err)
 
 json_t *read_input(void)
 {
-    int ret, datalen, done;
+    int ret, datalen, done, timeout, dbtimeout;
+    time_t idle_since;
     static char commbuf[COMMBUF_SIZE];
     char *bp;
     json_t *jval = NULL;
@@ -147,10 +187,24 @@ json_t *read_input(void)
     
     done = FALSE;
     datalen = 0;
+    idle_since = time(NULL);
     while (!done && !termination_flag) {
-	ret = poll(pfd, 1, settings.client_timeout * 1000);
-	if (ret == 0)
+	/* wake up early if deferred database updates become due meanwhile */
+	timeout = (idle_since + settings.client_timeout - time(NULL)) * 1000;
+	dbtimeout = db_update_timeout();
+	if (dbtimeout >= 0 && dbtimeout < timeout)
+	    timeout = dbtimeout;
+	if (timeout < 0)
+	    timeout = 0;
+	
+	ret = poll(pfd, 1, timeout);
+	if (ret == 0) {
+	    if (db_update_timeout() >= 0) {
+		db_flush_updates();
+		continue;
+	    }
 	    exit_client("Inactivity timeout");
+	}
 	
 	ret = read(infd, &commbuf[datalen], COMMBUF_SIZE - datalen - 1);
 	if (ret == -1)
@@ -158,6 +212,7 @@ json_t *read_input(void)
 	else if (ret == 0)
 	    exit_client("Input pipe lost");
 	datalen += ret;
+	idle_since = time(NULL);
 	
 	if (commbuf[datalen-ret] == '\033') {
 	    /* this is a request to reset the buffer when recovering from a
@@ -245,24 +300,19 @@ static void client_main_loop(void)
  */
 void client_main(int userid, int _infd, int _outfd)
 {
-    char **gamepaths;
-    int i;
-    
     infd = _infd;
     outfd = _outfd;
     gamefd = -1;
     
-    init_database();
+    if (!db_ready)
+	init_database();
     if (!db_get_user_info(userid, &user_info)) {
 	log_msg("get_user_info error for uid %d!", userid);
 	exit_client("database error");
     }
     
-    gamepaths = init_game_paths();
-    nh_lib_init(&server_windowprocs, gamepaths);
-    for (i = 0; i < PREFIX_COUNT; i++)
-	free(gamepaths[i]);
-    free(gamepaths);
+    if (!lib_ready)
+	init_game_lib();
 
     db_restore_options(userid);
     
@@ -179,6 +179,72 @@ static int parse_config_line(char *line)
 	}
     }
     
+    else if (!strcmp(line, "log_compression")) {
+	if (!settings.log_compression)
+	    settings.log_compression = atoi(val);
+	
+	if (settings.log_compression < 1 || settings.log_compression > 9) {
+	    fprintf(stderr, "Error: the value for log_compression must be in the"
+	                    " range [1, 9].\n");
+	    return FALSE;
+	}
+    }
+    
+    else if (!strcmp(line, "sync_gamelog")) {
+	if (*val == '1' || !strcmp(val, "true"))
+	    settings.sync_gamelog = TRUE;
+	else if (*val != '0' && strcmp(val, "false")) {
+	    fprintf(stderr, "Error: sync_gamelog may only be set to \"0\", \"1\", "
+	                    "\"true\" or \"false\".\n");
+	    return FALSE;
+	}
+    }
+    
+    else if (!strcmp(line, "gamelog_header_interval")) {
+	if (!settings.gamelog_header_interval)
+	    settings.gamelog_header_interval = atoi(val);
+	
+	if (settings.gamelog_header_interval < 1 ||
+	    settings.gamelog_header_interval > 1000) {
+	    fprintf(stderr, "Error: the value for gamelog_header_interval must "
+	                    "be in the range [1, 1000].\n");
+	    return FALSE;
+	}
+    }
+    
+    else if (!strcmp(line, "zygote")) {
+	if (*val == '1' || !strcmp(val, "true"))
+	    settings.zygote = TRUE;
+	else if (*val != '0' && strcmp(val, "false")) {
+	    fprintf(stderr, "Error: zygote may only be set to \"0\", \"1\", "
+	                    "\"true\" or \"false\".\n");
+	    return FALSE;
+	}
+    }
+    
+    else if (!strcmp(line, "zygote_spares")) {
+	if (!settings.zygote_spares)
+	    settings.zygote_spares = atoi(val);
+	
+	if (settings.zygote_spares < 1 || settings.zygote_spares > 16) {
+	    fprintf(stderr, "Error: the value for zygote_spares must "
+	                    "be in the range [1, 16].\n");
+	    return FALSE;
+	}
+    }
+    
+    else if (!strcmp(line, "db_update_interval")) {
+	if (!settings.db_update_interval)
+	    settings.db_update_interval = atoi(val);
+	
+	if (settings.db_update_interval < 1 ||
+	    settings.db_update_interval > 600) {
+	    fprintf(stderr, "Error: the value for db_update_interval must "
+	                    "be in the range [1, 600].\n");
+	    return FALSE;
+	}
+    }
+    
     else if (!strcmp(line, "dbhost")) {
 	if (!settings.dbhost)
 	    settings.dbhost = strdup(val);
@@ -292,6 +358,12 @@ void setup_defaults(void)
     
     if (!settings.client_timeout)
 	settings.client_timeout = DEFAULT_CLIENT_TIMEOUT;
+    
+    if (!settings.zygote_spares)
+	settings.zygote_spares = DEFAULT_ZYGOTE_SPARES;
+    
+    if (!settings.db_update_interval)
+	settings.db_update_interval = DEFAULT_DB_UPDATE_INTERVAL;
 }
 
 
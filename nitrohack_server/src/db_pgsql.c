@@ -5,6 +5,8 @@
  */
 
 #include "nhserver.h"
+#include <ctype.h>
+#include <time.h>
 
 #if defined(LIBPQFE_IN_SUBDIR)
 # include <postgresql/libpq-fe.h>
@@ -15,6 +17,9 @@
 /* prepared statement names */
 #define PREP_AUTH	"auth_user"
 #define PREP_REGISTER	"register_user"
+#define PREP_UPDATE_USER	"update_user_ts"
+#define PREP_UPDATE_GAME	"update_game"
+#define PREP_UPDATE_BOTH	"update_user_game"
 
 /* SQL statements used */
 static const char SQL_init_user_table[] =
@@ -41,12 +46,18 @@ static const char SQL_init_games_table[] =
        "moves integer NOT NULL, "
        "depth integer NOT NULL, "
        "level_desc text NOT NULL, "
+       "has_amulet boolean NOT NULL DEFAULT FALSE, "
        "done boolean NOT NULL DEFAULT FALSE, "
        "owner integer NOT NULL REFERENCES users (uid), "
        "ts timestamp NOT NULL, "
        "start_ts timestamp NOT NULL"
     ");";
 
+/* columns added to the games table after it was first created */
+static const char SQL_upgrade_games_table[] =
+    "ALTER TABLE games "
+    "ADD COLUMN IF NOT EXISTS has_amulet boolean NOT NULL DEFAULT FALSE;";
+
 static const char SQL_init_options_table[] =
     "CREATE TABLE options("
 	"uid integer NOT NULL REFERENCES users (uid), "
@@ -94,10 +105,14 @@ static const char SQL_get_user_info[] =
     "FROM   users "
     "WHERE  uid = $1::bigint";
 
-static const char SQL_update_user_ts[] =
-    "UPDATE users "
-    "SET ts = 'now' "
-    "WHERE uid = $1::integer;";
+/* The timestamps of deferred updates are passed in, so that they record when
+ * the update was made rather than when it was written. */
+#define UPDATE_USER_TS_SQL \
+    "UPDATE users " \
+    "SET ts = to_timestamp($2::double precision) " \
+    "WHERE uid = $1::integer"
+
+static const char SQL_update_user_ts[] = UPDATE_USER_TS_SQL ";";
 
 static const char SQL_set_user_email[] =
     "UPDATE users "
@@ -121,10 +136,21 @@ static const char SQL_delete_game[] =
 static const char SQL_last_game_id[] =
     "SELECT currval('games_gid_seq');";
 
-static const char SQL_update_game[] =
-    "UPDATE games "
-    "SET ts = 'now', moves = $2::integer, depth = $3::integer, level_desc = $4::text "
-    "WHERE gid = $1::integer;";
+#define UPDATE_GAME_SQL \
+    "UPDATE games " \
+    "SET ts = to_timestamp($6::double precision), moves = $2::integer, " \
+        "depth = $3::integer, level_desc = $4::text, has_amulet = $5::boolean " \
+    "WHERE gid = $1::integer"
+
+static const char SQL_update_game[] = UPDATE_GAME_SQL ";";
+
+/* both of the above in one round trip; the user's parameters are $7 and $8 */
+static const char SQL_update_user_game[] =
+    "WITH u AS ("
+        "UPDATE users "
+        "SET ts = to_timestamp($8::double precision) "
+        "WHERE uid = $7::integer"
+    ") " UPDATE_GAME_SQL ";";
 
 static const char SQL_get_game_filename[] =
     "SELECT filename "
@@ -137,8 +163,11 @@ static const char SQL_set_game_done[] =
     "WHERE gid = $1::integer;";
 
 static const char SQL_list_games[] =
-    "SELECT g.gid, g.filename, u.name "
+    "SELECT g.gid, g.filename, u.name, g.plname, g.role, g.race, g.gender, "
+           "g.alignment, g.mode, g.moves, g.depth, g.level_desc, g.has_amulet, "
+           "COALESCE(t.death, '') AS death "
     "FROM games AS g JOIN users AS u ON g.owner = u.uid "
+                    "LEFT JOIN topten AS t ON g.gid = t.gid "
     "WHERE (u.uid = $1::integer OR $1::integer = 0) AND g.done = $2::boolean "
     "ORDER BY g.ts DESC "
     "LIMIT $3::integer;";
@@ -165,6 +194,27 @@ static const char SQL_add_topten_entry[] =
 
 static PGconn *conn;
 
+/*
+ * Write-behind for the updates made on every command.  A client process only
+ * ever updates its own user and game, so only the latest values are kept and
+ * written together every settings.db_update_interval seconds, or before any
+ * other query and when the database is closed.  Updates are sent without
+ * waiting for the reply; it is collected before the next query.
+ */
+static struct pending_updates {
+    int uid;			/* 0: no user update pending */
+    time_t user_ts;
+    int gid;			/* 0: no game update pending */
+    int moves, depth, has_amulet;
+    char levdesc[COLNO];
+    time_t game_ts;
+    time_t since;		/* when the oldest pending update was made */
+} pending;
+
+static int updates_prepared;	/* update statements prepared on conn */
+static int update_in_flight;	/* a reply to collect before the next query */
+static time_t last_update_flush;
+
 
 /*
  * init the database connection.
@@ -176,6 +226,8 @@ int init_database(void)
 
     conn = PQsetdbLogin(settings.dbhost, settings.dbport, NULL, NULL,
 			settings.dbname, settings.dbuser, settings.dbpass);
+    updates_prepared = FALSE;
+    update_in_flight = FALSE;
     if (PQstatus(conn) == CONNECTION_BAD) {
 	fprintf(stderr, "Database connection failed. Check your settings.\n");
 	goto err;
@@ -245,6 +297,14 @@ int check_database(void)
 	!check_create_table("options", SQL_init_options_table))
 	goto err;
     
+    res = PQexec(conn, SQL_upgrade_games_table);
+    if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+	fprintf(stderr, "Failed to upgrade table games: %s", PQerrorMessage(conn));
+	PQclear(res);
+	goto err;
+    }
+    PQclear(res);
+    
     /*
      * Create prepared statements
      */
@@ -274,11 +334,147 @@ err:
 
 void close_database(void)
 {
+    if (conn)
+	db_flush_updates();
     PQfinish(conn);
     conn = NULL;
 }
 
 
+/* Prepare the update statements on this connection.  This isn't done in
+ * check_database() because each client process has its own connection. */
+static int prepare_updates(void)
+{
+    static const struct {
+	const char *name, *sql;
+    } stmts[] = {
+	{PREP_UPDATE_USER, SQL_update_user_ts},
+	{PREP_UPDATE_GAME, SQL_update_game},
+	{PREP_UPDATE_BOTH, SQL_update_user_game},
+    };
+    PGresult *res;
+    int i;
+    
+    if (updates_prepared)
+	return TRUE;
+    
+    for (i = 0; i < sizeof(stmts) / sizeof(stmts[0]); i++) {
+	res = PQprepare(conn, stmts[i].name, stmts[i].sql, 0, NULL);
+	if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+	    log_msg("prepare statement %s failed: %s", stmts[i].name,
+		    PQerrorMessage(conn));
+	    PQclear(res);
+	    return FALSE;
+	}
+	PQclear(res);
+    }
+    
+    updates_prepared = TRUE;
+    return TRUE;
+}
+
+
+/* Collect the reply to the last batch of updates, if there is one. */
+static void finish_updates(void)
+{
+    PGresult *res;
+    
+    if (!update_in_flight)
+	return;
+    
+    while ((res = PQgetResult(conn))) {
+	if (PQresultStatus(res) != PGRES_COMMAND_OK)
+	    log_msg("deferred update error: %s", PQerrorMessage(conn));
+	PQclear(res);
+    }
+    update_in_flight = FALSE;
+}
+
+
+/* Send the pending updates as a single statement, without waiting. */
+static void send_updates(void)
+{
+    char gidstr[16], movesstr[16], depthstr[16], gtsstr[24];
+    char uidstr[16], utsstr[24];
+    const char *params[8];
+    const char *stmt;
+    int nparams;
+    
+    finish_updates();
+    if (!pending.uid && !pending.gid)
+	return;
+    
+    last_update_flush = time(NULL);
+    if (!prepare_updates()) {
+	memset(&pending, 0, sizeof(pending));
+	return;
+    }
+    
+    sprintf(uidstr, "%d", pending.uid);
+    sprintf(utsstr, "%ld", (long)pending.user_ts);
+    if (pending.gid) {
+	sprintf(gidstr, "%d", pending.gid);
+	sprintf(movesstr, "%d", pending.moves);
+	sprintf(depthstr, "%d", pending.depth);
+	sprintf(gtsstr, "%ld", (long)pending.game_ts);
+	params[0] = gidstr;
+	params[1] = movesstr;
+	params[2] = depthstr;
+	params[3] = pending.levdesc;
+	params[4] = pending.has_amulet ? "t" : "f";
+	params[5] = gtsstr;
+	params[6] = uidstr;
+	params[7] = utsstr;
+	stmt = pending.uid ? PREP_UPDATE_BOTH : PREP_UPDATE_GAME;
+	nparams = pending.uid ? 8 : 6;
+    } else {
+	params[0] = uidstr;
+	params[1] = utsstr;
+	stmt = PREP_UPDATE_USER;
+	nparams = 2;
+    }
+    
+    if (PQsendQueryPrepared(conn, stmt, nparams, params, NULL, NULL, 0))
+	update_in_flight = TRUE;
+    else
+	log_msg("deferred update error: %s", PQerrorMessage(conn));
+    memset(&pending, 0, sizeof(pending));
+}
+
+
+/* An update was added to pending; send the batch if it's been long enough. */
+static void note_pending_update(void)
+{
+    time_t now = time(NULL);
+    
+    if (!pending.since)
+	pending.since = now;
+    if (now - last_update_flush >= settings.db_update_interval)
+	send_updates();
+}
+
+
+/* Write all pending updates and wait for them to complete. */
+void db_flush_updates(void)
+{
+    send_updates();
+    finish_updates();
+}
+
+
+/* Milliseconds until the pending updates are due to be written, or -1 if
+ * there are none. */
+int db_update_timeout(void)
+{
+    time_t due;
+    
+    if (!pending.since)
+	return -1;
+    due = pending.since + settings.db_update_interval;
+    return due > time(NULL) ? (due - time(NULL)) * 1000 : 0;
+}
+
+
 int db_auth_user(const char *name, const char *pass)
 {
     PGresult *res;
@@ -286,6 +482,7 @@ int db_auth_user(const char *name, const char *pass)
     int uid, auth_ok, col;
     const char *uidstr;
     
+    db_flush_updates();
     res = PQexecPrepared(conn, PREP_AUTH, 2, params, NULL, NULL, 0);
     if (PQresultStatus(res) != PGRES_TUPLES_OK || PQntuples(res) == 0) {
         PQclear(res);
@@ -311,6 +508,7 @@ int db_register_user(const char *name, const char *pass, const char *email)
     int uid;
     const char *uidstr;
     
+    db_flush_updates();
     res = PQexecPrepared(conn, PREP_REGISTER, 3, params, NULL, NULL, 0);
     if (PQresultStatus(res) != PGRES_COMMAND_OK) {
 	log_msg("db_register_user failed: %s", PQerrorMessage(conn));
@@ -343,6 +541,7 @@ int db_get_user_info(int uid, struct user_info *info)
     
     sprintf(uidstr, "%d", uid);
     
+    db_flush_updates();
     res = PQexecParams(conn, SQL_get_user_info, 1, NULL, params, NULL, paramFormats, 0);
     if (PQresultStatus(res) != PGRES_TUPLES_OK || PQntuples(res) == 0) {
 	log_msg("db_get_user_info error: %s", PQerrorMessage(conn));
@@ -365,16 +564,11 @@ int db_get_user_info(int uid, struct user_info *info)
 
 void db_update_user_ts(int uid)
 {
-    PGresult *res;
-    char uidstr[16];
-    const char * const params[] = {uidstr};
-    const int paramFormats[] = {0}; /* text format */
-    
-    sprintf(uidstr, "%d", uid);
-    res = PQexecParams(conn, SQL_update_user_ts, 1, NULL, params, NULL, paramFormats, 0);
-    if (PQresultStatus(res) != PGRES_COMMAND_OK)
-	log_msg("update_user_ts error: %s", PQerrorMessage(conn));
-    PQclear(res);
+    if (pending.uid && pending.uid != uid)
+	send_updates();
+    pending.uid = uid;
+    pending.user_ts = time(NULL);
+    note_pending_update();
 }
 
 
@@ -388,6 +582,7 @@ int db_set_user_email(int uid, const char *email)
     
     sprintf(uidstr, "%d", uid);
     
+    db_flush_updates();
     res = PQexecParams(conn, SQL_set_user_email, 2, NULL, params, NULL, paramFormats, 0);
     numrows = PQcmdTuples(res);
     if (PQresultStatus(res) == PGRES_COMMAND_OK && atoi(numrows) == 1) {
@@ -409,6 +604,7 @@ int db_set_user_password(int uid, const char *password)
     
     sprintf(uidstr, "%d", uid);
     
+    db_flush_updates();
     res = PQexecParams(conn, SQL_set_user_password, 2, NULL, params, NULL, paramFormats, 0);
     numrows = PQcmdTuples(res);
     if (PQresultStatus(res) == PGRES_COMMAND_OK && atoi(numrows) == 1) {
@@ -435,6 +631,7 @@ long db_add_new_game(int uid, const char *filename, const char *role,
     sprintf(uidstr, "%d", uid);
     sprintf(modestr, "%d", mode);
     
+    db_flush_updates();
     res = PQexecParams(conn, SQL_add_game, 9, NULL, params, NULL, paramFormats, 0);
     if (PQresultStatus(res) != PGRES_COMMAND_OK) {
 	log_msg("db_add_new_game error while adding (%s - %s): %s",
@@ -457,21 +654,18 @@ long db_add_new_game(int uid, const char *filename, const char *role,
 }
 
 
-void db_update_game(int gameid, int moves, int depth, const char *levdesc)
+void db_update_game(int gameid, int moves, int depth, const char *levdesc,
+		    int has_amulet)
 {
-    PGresult *res;
-    char gidstr[16], movesstr[16], depthstr[16];
-    const char * const params[] = {gidstr, movesstr, depthstr, levdesc};
-    const int paramFormats[] = {0,0,0,0};
-    
-    sprintf(gidstr, "%d", gameid);
-    sprintf(movesstr, "%d", moves);
-    sprintf(depthstr, "%d", depth);
-    
-    res = PQexecParams(conn, SQL_update_game, 4, NULL, params, NULL, paramFormats, 0);
-    if (PQresultStatus(res) != PGRES_COMMAND_OK)
-	log_msg("update_game_ts error: %s", PQerrorMessage(conn));
-    PQclear(res);
+    if (pending.gid && pending.gid != gameid)
+	send_updates();
+    pending.gid = gameid;
+    pending.moves = moves;
+    pending.depth = depth;
+    snprintf(pending.levdesc, sizeof(pending.levdesc), "%s", levdesc);
+    pending.has_amulet = has_amulet;
+    pending.game_ts = time(NULL);
+    note_pending_update();
 }
 
 
@@ -485,6 +679,7 @@ int db_get_game_filename(int uid, int gid, char *namebuf, int buflen)
     sprintf(uidstr, "%d", uid);
     sprintf(gidstr, "%d", gid);
     
+    db_flush_updates();
     res = PQexecParams(conn, SQL_get_game_filename, 2, NULL, params, NULL, paramFormats, 0);
     if (PQresultStatus(res) != PGRES_TUPLES_OK || PQntuples(res) == 0) {
 	log_msg("get_game_filename error: %s", PQerrorMessage(conn));
@@ -508,6 +703,7 @@ void db_delete_game(int uid, int gid)
     sprintf(uidstr, "%d", uid);
     sprintf(gidstr, "%d", gid);
     
+    db_flush_updates();
     res = PQexecParams(conn, SQL_delete_game, 2, NULL, params, NULL, paramFormats, 0);
     if (PQresultStatus(res) != PGRES_COMMAND_OK)
 	log_msg("db_delete_game error: %s", PQerrorMessage(conn));
@@ -519,7 +715,8 @@ void db_delete_game(int uid, int gid)
 struct gamefile_info *db_list_games(int completed, int uid, int limit, int *count)
 {
     PGresult *res;
-    int i, gidcol, fncol, ucol;
+    int i, gidcol, fncol, ucol, pncol, rolecol, racecol, gendcol, aligncol;
+    int modecol, movescol, depthcol, ldcol, amucol, deathcol;
     struct gamefile_info *files;
     char uidstr[16], complstr[16], limitstr[16];
     const char * const params[] = {uidstr, complstr, limitstr};
@@ -532,6 +729,7 @@ struct gamefile_info *db_list_games(int completed, int uid, int limit, int *coun
     sprintf(complstr, "%d", !!completed);
     sprintf(limitstr, "%d", limit);
     
+    db_flush_updates();
     res = PQexecParams(conn, SQL_list_games, 3, NULL, params, NULL, paramFormats, 0);
     if (PQresultStatus(res) != PGRES_TUPLES_OK) {
 	log_msg("list_games error: %s", PQerrorMessage(conn));
@@ -544,12 +742,40 @@ struct gamefile_info *db_list_games(int completed, int uid, int limit, int *coun
     gidcol = PQfnumber(res, "gid");
     fncol = PQfnumber(res, "filename");
     ucol = PQfnumber(res, "name");
-    
-    files = malloc(sizeof(struct gamefile_info) * (*count));
+    pncol = PQfnumber(res, "plname");
+    rolecol = PQfnumber(res, "role");
+    racecol = PQfnumber(res, "race");
+    gendcol = PQfnumber(res, "gender");
+    aligncol = PQfnumber(res, "alignment");
+    modecol = PQfnumber(res, "mode");
+    movescol = PQfnumber(res, "moves");
+    depthcol = PQfnumber(res, "depth");
+    ldcol = PQfnumber(res, "level_desc");
+    amucol = PQfnumber(res, "has_amulet");
+    deathcol = PQfnumber(res, "death");
+    
+    files = calloc(*count, sizeof(struct gamefile_info));
     for (i = 0; i < *count; i++) {
+	struct nh_game_info *gi = &files[i].gi;
+	
 	files[i].gid = atoi(PQgetvalue(res, i, gidcol));
 	files[i].filename = strdup(PQgetvalue(res, i, fncol));
 	files[i].username = strdup(PQgetvalue(res, i, ucol));
+	
+	/* everything the game list shows is kept in the games table, so
+	 * listing games doesn't need to read the game files */
+	gi->playmode = atoi(PQgetvalue(res, i, modecol));
+	strncpy(gi->name, PQgetvalue(res, i, pncol), PL_NSIZ - 1);
+	strncpy(gi->plrole, PQgetvalue(res, i, rolecol), PLRBUFSZ - 1);
+	gi->plrole[0] = tolower(gi->plrole[0]); /* as in the game log header */
+	strncpy(gi->plrace, PQgetvalue(res, i, racecol), PLRBUFSZ - 1);
+	strncpy(gi->plgend, PQgetvalue(res, i, gendcol), PLRBUFSZ - 1);
+	strncpy(gi->plalign, PQgetvalue(res, i, aligncol), PLRBUFSZ - 1);
+	strncpy(gi->level_desc, PQgetvalue(res, i, ldcol), COLNO - 1);
+	gi->moves = atoi(PQgetvalue(res, i, movescol));
+	gi->depth = atoi(PQgetvalue(res, i, depthcol));
+	gi->has_amulet = PQgetvalue(res, i, amucol)[0] == 't';
+	strncpy(gi->death, PQgetvalue(res, i, deathcol), BUFSZ - 1);
     }
     
     PQclear(res);
@@ -568,6 +794,7 @@ void db_set_option(int uid, const char *optname, int type, const char *optval)
     sprintf(uidstr, "%d", uid);
     sprintf(typestr, "%d", type);
     
+    db_flush_updates();
     /* try to update first */
     res = PQexecParams(conn, SQL_update_option, 3, NULL, params, NULL, paramFormats, 0);
     numrows = PQcmdTuples(res);
@@ -604,6 +831,7 @@ void db_restore_options(int uid)
 
     sprintf(uidstr, "%d", uid);
     
+    db_flush_updates();
     res = PQexecParams(conn, SQL_get_options, 1, NULL, params, NULL, paramFormats, 0);
     if (PQresultStatus(res) != PGRES_TUPLES_OK) {
 	log_msg("get_options error: %s", PQerrorMessage(conn));
@@ -639,6 +867,7 @@ void db_add_topten_entry(int gid, int points, int hp, int maxhp, int deaths,
     sprintf(dcountstr, "%d", deaths);
     sprintf(endstr, "%d", end_how);
     
+    db_flush_updates();
     res = PQexecParams(conn, SQL_add_topten_entry, 8, NULL, params, NULL, paramFormats, 0);
     if (PQresultStatus(res) != PGRES_COMMAND_OK)
 	log_msg("add_topten_entry error: %s", PQerrorMessage(conn));
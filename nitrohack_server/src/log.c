@@ -110,6 +110,8 @@ void report_startup(void)
     log_msg("  unixsocket = %s", addr2str(&settings.bind_addr_unix));
     log_msg("  port = %d", settings.port);
     log_msg("  client_timeout = %d", settings.client_timeout);
+    if (settings.zygote)
+	log_msg("  zygote = true (%d spares)", settings.zygote_spares);
     
     /* database settings */
     log_msg("  dbhost = %s", settings.dbhost ? settings.dbhost : "(not set)");
@@ -117,6 +119,7 @@ void report_startup(void)
     log_msg("  dbuser = %s", settings.dbuser ? settings.dbuser : "(not set)");
     log_msg("  dbpass = %s", settings.dbpass ? "(not shown)" : "(not set)");
     log_msg("  dbname = %s", settings.dbname ? settings.dbname : "(not set)");
+    log_msg("  db_update_interval = %d", settings.db_update_interval);
     
     startup_pid = getpid();
 }
@@ -54,6 +54,8 @@
 #include <netinet/tcp.h>
 #include <sys/epoll.h>
 #include <sys/time.h>
+#include <signal.h>
+#include <dirent.h>
 
 #if defined(OPEN_MAX)
 static int get_open_max(void) { return OPEN_MAX; }
@@ -70,6 +72,11 @@ static int get_open_max(void) { return sysconf(_SC_OPEN_MAX); }
 /* make the buffer slightly bigger to detect when the client sends too much data */
 #define AUTHBUFSIZE 512
 
+/* Number of helper processes that check logins against the database. Each
+ * handles one login at a time, so a slow query delays at most the logins
+ * queued behind it and never the relaying of established games. */
+#define AUTH_WORKERS 4
+
 enum comm_status {
     NEW_CONNECTION,
     CLIENT_DISCONNECTED,
@@ -97,6 +104,42 @@ struct client_data {
 };
 
 
+/* A login waiting for an auth worker's verdict; the socket isn't watched by
+ * epoll until then. */
+struct auth_request {
+    int sock;
+    struct auth_request *next;
+};
+
+struct auth_worker {
+    int pid;
+    int fd; /* master <-> worker socket; -1 if the worker isn't running */
+    struct auth_request *queue, *queue_tail; /* sent to the worker, oldest first */
+    int queued;
+};
+
+/* upper limit for settings.zygote_spares */
+#define ZYGOTE_MAX_SPARES 16
+
+/* A new game handed to the zygote; its pid arrives via zygote_event. */
+struct zygote_request {
+    int connid;
+    struct zygote_request *next;
+};
+
+/* auth requests and replies; sent over SOCK_SEQPACKET, so they arrive whole */
+struct auth_msg {
+    char peername[128];
+    char authbuf[AUTHBUFSIZE];
+};
+
+struct auth_reply {
+    int userid;
+    int is_reg;
+    int reconnect_id;
+};
+
+
 /*---------------------------------------------------------------------------*/
 
 static struct client_data new_connection_dummy = {NEW_CONNECTION, 0 /*, 0 etc */};
@@ -113,6 +156,20 @@ static struct client_data connected_list_head;
 static struct client_data **fd_to_client;
 static int client_count, fd_to_client_max;
 
+/* time the master spends in fork_client to start game processes; the game
+ * processes log their own startup time, see log_game_start */
+static struct spawn_stats {
+    long count;
+    long long total_usec, max_usec;
+} spawn_stats;
+
+static struct auth_worker auth_workers[AUTH_WORKERS];
+
+/* master <-> zygote socket; -1 if game processes are forked directly */
+static int zygote_fd = -1;
+static int zygote_pid;
+static struct zygote_request *zygote_queue, *zygote_queue_tail;
+
 /*---------------------------------------------------------------------------*/
 
 
@@ -120,6 +177,7 @@ static void cleanup_game_process(struct client_data *client, int epfd);
 static int init_server_socket(struct sockaddr *sa);
 static int fork_client(struct client_data *client, int epfd);
 static void handle_new_connection(int newfd, int epfd);
+static void finish_new_connection(int newfd, const struct auth_reply *reply, int epfd);
 
 
 static void link_client_data(struct client_data *client, struct client_data *list)
@@ -233,6 +291,84 @@ static int init_server_socket(struct sockaddr *sa)
 }
 
 
+/* microseconds since *start */
+static long long usec_since(const struct timeval *start)
+{
+    struct timeval now, elapsed;
+    
+    gettimeofday(&now, NULL);
+    timersub(&now, start, &elapsed);
+    return elapsed.tv_sec * 1000000LL + elapsed.tv_usec;
+}
+
+
+/*
+ * Log how long a new game process took to get from fork (or from being handed
+ * its user, for a spare) to client_main. This includes post_fork_cleanup,
+ * which the master's spawn_stats can't see.
+ */
+static void log_game_start(const struct timeval *start, const char *since)
+{
+    log_msg("Game process %d ready %lld us after %s", getpid(),
+	    usec_since(start), since);
+}
+
+
+/*
+ * Close the CLOEXEC file descriptors of a freshly forked process.
+ * Only the descriptors that are actually open are looked at; checking every
+ * possible one costs a syscall per fd up to the (possibly huge) fd limit.
+ */
+static void close_cloexec_fds(void)
+{
+    DIR *dir;
+    struct dirent *ent;
+    int i, fd, count = 0, size = 64, *fds, *newfds;
+    
+    dir = opendir("/proc/self/fd");
+    if (!dir)
+	goto sweep;
+    
+    /* collect first: closing fds while reading the directory would change it */
+    fds = malloc(size * sizeof(int));
+    if (!fds) {
+	closedir(dir);
+	goto sweep;
+    }
+    while ((ent = readdir(dir))) {
+	if (!isdigit(ent->d_name[0]))
+	    continue;
+	fd = atoi(ent->d_name);
+	if (fd == dirfd(dir))
+	    continue;
+	if (count == size) {
+	    size *= 2;
+	    newfds = realloc(fds, size * sizeof(int));
+	    if (!newfds) {
+		free(fds);
+		closedir(dir);
+		goto sweep;
+	    }
+	    fds = newfds;
+	}
+	fds[count++] = fd;
+    }
+    closedir(dir);
+    
+    for (i = 0; i < count; i++)
+	if (fcntl(fds[i], F_GETFD) & FD_CLOEXEC)
+	    close(fds[i]);
+    free(fds);
+    return;
+    
+sweep:
+    /* no procfs or no memory: fall back to trying every descriptor */
+    for (i = 0; i < get_open_max(); i++)
+	if (fcntl(i, F_GETFD) & FD_CLOEXEC)
+	    close(i);
+}
+
+
 /*
  * The client inherits sevaral things that aren't needed to run a game
  * Free them here.
@@ -245,9 +381,7 @@ static void post_fork_cleanup(void)
     /* forking doesn't actually close any of the CLOEXEC file
      * descriptors. CLOEXEC is still nice to have and we can use it as
      * a flag to get rid of lots of stuff here. */
-    for (i = 0; i < get_open_max(); i++)
-	if (fcntl(i, F_GETFD) & FD_CLOEXEC)
-	    close(i);
+    close_cloexec_fds();
     
     for (ccur = disconnected_list_head.next; ccur; ccur = cnext) {
 	cnext = ccur->next;
@@ -259,10 +393,579 @@ static void post_fork_cleanup(void)
 	free(ccur);
     }
     
+    for (i = 0; i < AUTH_WORKERS; i++) {
+	struct auth_request *req, *rnext;
+	for (req = auth_workers[i].queue; req; req = rnext) {
+	    rnext = req->next;
+	    free(req);
+	}
+	auth_workers[i].queue = auth_workers[i].queue_tail = NULL;
+	auth_workers[i].fd = -1;
+    }
+    
+    while (zygote_queue) {
+	struct zygote_request *zreq = zygote_queue;
+	zygote_queue = zreq->next;
+	free(zreq);
+    }
+    zygote_queue_tail = NULL;
+    zygote_fd = -1;
+    
     free(fd_to_client);
 }
 
 
+/*
+ * The main loop of an auth worker process: check each login request against
+ * the database on the worker's own connection and send back the result.
+ */
+static void auth_worker_main(int fd)
+{
+    struct auth_msg msg;
+    struct auth_reply reply;
+    int ret;
+    
+    /* the main process answers for the message file */
+    signal(SIGUSR2, SIG_IGN);
+    
+    if (!init_database()) {
+	log_msg("auth worker %d could not connect to the database", getpid());
+	exit(1);
+    }
+    
+    while (!termination_flag) {
+	ret = recv(fd, &msg, sizeof(msg), 0);
+	if (ret == -1 && errno == EINTR)
+	    continue;
+	else if (ret <= 0) /* the main process is gone */
+	    break;
+	msg.peername[sizeof(msg.peername) - 1] = '\0';
+	msg.authbuf[AUTHBUFSIZE - 1] = '\0';
+	
+	memset(&reply, 0, sizeof(reply));
+	reply.userid = auth_user(msg.authbuf, msg.peername, &reply.is_reg,
+				 &reply.reconnect_id);
+	if (send(fd, &reply, sizeof(reply), MSG_NOSIGNAL) == -1)
+	    break;
+    }
+    
+    close_database();
+}
+
+
+/*
+ * Start (or restart) an auth worker process and register its socket with epoll.
+ */
+static int start_auth_worker(struct auth_worker *worker, int epfd)
+{
+    int sv[2];
+    struct epoll_event ev;
+    
+    /* both ends are CLOEXEC so that game processes don't inherit them */
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) == -1) {
+	log_msg("Failed to create a socket for an auth worker: %s", strerror(errno));
+	return FALSE;
+    }
+    
+    worker->pid = fork();
+    if (worker->pid == 0) { /* child */
+	fcntl(sv[1], F_SETFD, 0); /* keep this one through post_fork_cleanup */
+	post_fork_cleanup();
+	auth_worker_main(sv[1]);
+	exit(0);
+    } else if (worker->pid == -1) {
+	log_msg("Failed to fork an auth worker process: %s", strerror(errno));
+	close(sv[0]);
+	close(sv[1]);
+	worker->pid = 0;
+	return FALSE;
+    }
+    
+    close(sv[1]);
+    fcntl(sv[0], F_SETFL, O_NONBLOCK);
+    ev.data.ptr = NULL;
+    ev.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+    ev.data.fd = sv[0];
+    epoll_ctl(epfd, EPOLL_CTL_ADD, sv[0], &ev);
+    worker->fd = sv[0];
+    
+    return TRUE;
+}
+
+
+/*
+ * Shut down an auth worker. The logins it still had queued are dropped; the
+ * clients see the connection close and can retry.
+ */
+static void stop_auth_worker(struct auth_worker *worker, int epfd)
+{
+    struct auth_request *req;
+    
+    if (worker->fd != -1) {
+	epoll_ctl(epfd, EPOLL_CTL_DEL, worker->fd, NULL);
+	close(worker->fd);
+	worker->fd = -1;
+    }
+    if (worker->pid)
+	kill(worker->pid, SIGTERM);
+    worker->pid = 0;
+    
+    while ((req = worker->queue)) {
+	worker->queue = req->next;
+	close(req->sock);
+	free(req);
+    }
+    worker->queue_tail = NULL;
+    worker->queued = 0;
+}
+
+
+/*
+ * Pass a login to the auth worker with the shortest queue. Returns FALSE if
+ * no worker could take it.
+ */
+static int queue_auth_request(int newfd, const char *authbuf, const char *peername)
+{
+    struct auth_worker *worker = NULL;
+    struct auth_request *req;
+    struct auth_msg msg;
+    int i;
+    
+    for (i = 0; i < AUTH_WORKERS; i++)
+	if (auth_workers[i].fd != -1 &&
+	    (!worker || auth_workers[i].queued < worker->queued))
+	    worker = &auth_workers[i];
+    if (!worker)
+	return FALSE;
+    
+    memset(&msg, 0, sizeof(msg));
+    snprintf(msg.peername, sizeof(msg.peername), "%s", peername);
+    snprintf(msg.authbuf, sizeof(msg.authbuf), "%s", authbuf);
+    if (send(worker->fd, &msg, sizeof(msg), MSG_DONTWAIT | MSG_NOSIGNAL) == -1) {
+	log_msg("Failed to pass a login from %s to an auth worker: %s",
+		peername, strerror(errno));
+	return FALSE;
+    }
+    
+    req = malloc(sizeof(struct auth_request));
+    req->sock = newfd;
+    req->next = NULL;
+    if (worker->queue_tail)
+	worker->queue_tail->next = req;
+    else
+	worker->queue = req;
+    worker->queue_tail = req;
+    worker->queued++;
+    
+    return TRUE;
+}
+
+
+/*
+ * Collect the verdicts of an auth worker. A worker answers its requests in
+ * the order they were sent, so each reply belongs to the oldest queued login.
+ */
+static void auth_worker_event(struct auth_worker *worker, int epfd,
+			      unsigned int event_mask)
+{
+    struct auth_reply reply;
+    struct auth_request *req;
+    int ret, closed;
+    
+    closed = (event_mask & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)) != 0;
+    
+    while (worker->queue) {
+	ret = recv(worker->fd, &reply, sizeof(reply), MSG_DONTWAIT);
+	if (ret == -1 && errno == EINTR)
+	    continue;
+	else if (ret != sizeof(reply)) {
+	    if (ret == 0 || (ret == -1 && errno != EAGAIN && errno != EWOULDBLOCK))
+		closed = TRUE;
+	    break;
+	}
+	
+	req = worker->queue;
+	worker->queue = req->next;
+	if (!worker->queue)
+	    worker->queue_tail = NULL;
+	worker->queued--;
+	
+	finish_new_connection(req->sock, &reply, epfd);
+	free(req);
+    }
+    
+    if (closed) {
+	log_msg("Auth worker at pid %d has exited; %d logins dropped.",
+		worker->pid, worker->queued);
+	worker->pid = 0; /* reaped by the main loop */
+	stop_auth_worker(worker, epfd);
+	if (!termination_flag)
+	    start_auth_worker(worker, epfd);
+    }
+}
+
+
+/*
+ * Pass a user id and the game end of a new game's pipes over a unix socket.
+ */
+static int send_game_fds(int sock, int userid, int infd, int outfd)
+{
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+    char cbuf[CMSG_SPACE(2 * sizeof(int))];
+    int *fds;
+    
+    memset(&msg, 0, sizeof(msg));
+    memset(cbuf, 0, sizeof(cbuf));
+    iov.iov_base = &userid;
+    iov.iov_len = sizeof(userid);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf;
+    msg.msg_controllen = sizeof(cbuf);
+    
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(2 * sizeof(int));
+    fds = (int*)CMSG_DATA(cmsg);
+    fds[0] = infd;
+    fds[1] = outfd;
+    
+    return sendmsg(sock, &msg, MSG_DONTWAIT | MSG_NOSIGNAL) == sizeof(userid);
+}
+
+
+/*
+ * Receive what send_game_fds sent. Returns the recvmsg result; fds are only
+ * valid if it is positive.
+ */
+static int recv_game_fds(int sock, int *userid, int *infd, int *outfd)
+{
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+    char cbuf[CMSG_SPACE(2 * sizeof(int))];
+    int ret, *fds;
+    
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base = userid;
+    iov.iov_len = sizeof(*userid);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf;
+    msg.msg_controllen = sizeof(cbuf);
+    
+    ret = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+    if (ret <= 0)
+	return ret;
+    
+    cmsg = CMSG_FIRSTHDR(&msg);
+    if (ret != sizeof(*userid) || !cmsg || cmsg->cmsg_type != SCM_RIGHTS ||
+	cmsg->cmsg_len != CMSG_LEN(2 * sizeof(int))) {
+	errno = EPROTO;
+	return -1;
+    }
+    fds = (int*)CMSG_DATA(cmsg);
+    *infd = fds[0];
+    *outfd = fds[1];
+    /* the game process inherits these */
+    fcntl(*infd, F_SETFD, 0);
+    fcntl(*outfd, F_SETFD, 0);
+    
+    return ret;
+}
+
+
+/*
+ * Turn a process forked by the zygote into a game process.
+ */
+static void zygote_run_game(int userid, int infd, int outfd,
+			    const struct timeval *start, const char *since)
+{
+    signal(SIGCHLD, SIG_DFL);
+    setup_signals();
+    log_game_start(start, since);
+    client_main(userid, infd, outfd);
+    exit(0);
+}
+
+
+/*
+ * A spare game process: it is connected to the database and waits for the
+ * zygote to hand it a user.
+ */
+static void zygote_spare_main(int fd)
+{
+    int ret, userid, infd, outfd;
+    struct timeval start;
+    
+    client_preconnect();
+    
+    while (!termination_flag) {
+	ret = recv_game_fds(fd, &userid, &infd, &outfd);
+	if (ret == -1 && errno == EINTR)
+	    continue;
+	else if (ret <= 0) /* the zygote is gone */
+	    break;
+	
+	gettimeofday(&start, NULL);
+	close(fd);
+	zygote_run_game(userid, infd, outfd, &start, "handoff");
+    }
+    
+    close_database();
+}
+
+
+/*
+ * The zygote's main loop. Game processes are forked from here with the game
+ * library initialized and its data loaded; settings.zygote_spares of them are
+ * kept waiting, so that a new game only needs to be handed its pipes.
+ */
+static void zygote_main(int fd)
+{
+    struct {
+	int pid;
+	int fd; /* zygote <-> spare socket; -1 if the slot is empty */
+    } spares[ZYGOTE_MAX_SPARES];
+    int i, j, ret, userid, infd, outfd, pid, sv[2];
+    struct timeval start;
+    
+    /* the main process answers for the message file; game processes are
+     * reaped automatically */
+    signal(SIGUSR2, SIG_IGN);
+    signal(SIGCHLD, SIG_IGN);
+    
+    if (!client_preload())
+	log_msg("The zygote could not preload the game data.");
+    
+    for (i = 0; i < settings.zygote_spares; i++)
+	spares[i].fd = -1;
+    
+    while (!termination_flag) {
+	/* refill the pool of spares */
+	for (i = 0; i < settings.zygote_spares; i++) {
+	    if (spares[i].fd != -1)
+		continue;
+	    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) == -1)
+		break;
+	    spares[i].pid = fork();
+	    if (spares[i].pid == 0) {
+		close(fd);
+		close(sv[0]);
+		for (j = 0; j < settings.zygote_spares; j++)
+		    if (spares[j].fd != -1)
+			close(spares[j].fd);
+		zygote_spare_main(sv[1]);
+		exit(0);
+	    }
+	    close(sv[1]);
+	    if (spares[i].pid == -1) {
+		close(sv[0]);
+		break;
+	    }
+	    spares[i].fd = sv[0];
+	}
+	
+	ret = recv_game_fds(fd, &userid, &infd, &outfd);
+	if (ret == -1 && errno == EINTR)
+	    continue;
+	else if (ret <= 0) /* the main process is gone */
+	    break;
+	
+	/* hand the game to a spare... */
+	pid = -1;
+	for (i = 0; i < settings.zygote_spares && pid == -1; i++) {
+	    if (spares[i].fd == -1)
+		continue;
+	    if (send_game_fds(spares[i].fd, userid, infd, outfd))
+		pid = spares[i].pid;
+	    close(spares[i].fd); /* gone either way */
+	    spares[i].fd = -1;
+	}
+	
+	/* ... or fork a game process for it if there is none */
+	if (pid == -1) {
+	    gettimeofday(&start, NULL);
+	    pid = fork();
+	    if (pid == 0) {
+		close(fd);
+		for (j = 0; j < settings.zygote_spares; j++)
+		    if (spares[j].fd != -1)
+			close(spares[j].fd);
+		zygote_run_game(userid, infd, outfd, &start, "fork");
+	    }
+	}
+	
+	close(infd);
+	close(outfd);
+	if (send(fd, &pid, sizeof(pid), MSG_NOSIGNAL) == -1)
+	    break;
+    }
+    
+    for (i = 0; i < settings.zygote_spares; i++)
+	if (spares[i].fd != -1)
+	    close(spares[i].fd);
+}
+
+
+static void start_zygote(int epfd)
+{
+    int sv[2];
+    struct epoll_event ev;
+    
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) == -1) {
+	log_msg("Failed to create a socket for the zygote: %s", strerror(errno));
+	return;
+    }
+    
+    zygote_pid = fork();
+    if (zygote_pid == 0) { /* child */
+	fcntl(sv[1], F_SETFD, 0); /* keep this one through post_fork_cleanup */
+	post_fork_cleanup();
+	zygote_main(sv[1]);
+	exit(0);
+    } else if (zygote_pid == -1) {
+	log_msg("Failed to fork the zygote: %s", strerror(errno));
+	close(sv[0]);
+	close(sv[1]);
+	zygote_pid = 0;
+	return;
+    }
+    
+    close(sv[1]);
+    fcntl(sv[0], F_SETFL, O_NONBLOCK);
+    ev.data.ptr = NULL;
+    ev.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+    ev.data.fd = sv[0];
+    epoll_ctl(epfd, EPOLL_CTL_ADD, sv[0], &ev);
+    zygote_fd = sv[0];
+    log_msg("Zygote started at pid %d", zygote_pid);
+}
+
+
+/*
+ * Shut down the zygote. Games it was still starting keep running if a game
+ * process got them, but their pids stay unknown; if none did, the game end of
+ * their pipes is closed and they are cleaned up like any other exited game.
+ */
+static void stop_zygote(int epfd)
+{
+    struct zygote_request *zreq;
+    
+    if (zygote_fd != -1) {
+	epoll_ctl(epfd, EPOLL_CTL_DEL, zygote_fd, NULL);
+	close(zygote_fd);
+    }
+    if (zygote_pid)
+	kill(zygote_pid, SIGTERM);
+    zygote_fd = -1;
+    zygote_pid = 0;
+    
+    while ((zreq = zygote_queue)) {
+	zygote_queue = zreq->next;
+	free(zreq);
+    }
+    zygote_queue_tail = NULL;
+}
+
+
+/*
+ * Hand a new game to the zygote. The zygote only passes on the fds or forks,
+ * but the master doesn't wait for it: the pid of the game process is filled in
+ * by zygote_event. Returns FALSE if the game must be forked directly.
+ */
+static int zygote_fork_client(struct client_data *client, int infd, int outfd,
+			      int epfd)
+{
+    struct zygote_request *zreq;
+    
+    if (!send_game_fds(zygote_fd, client->userid, infd, outfd)) {
+	if (errno == EAGAIN || errno == EWOULDBLOCK)
+	    return FALSE; /* busy; this one is forked directly */
+	log_msg("Failed to pass a game to the zygote (%s); "
+		"forking them directly from now on.", strerror(errno));
+	stop_zygote(epfd);
+	return FALSE;
+    }
+    
+    zreq = malloc(sizeof(struct zygote_request));
+    zreq->connid = client->connid;
+    zreq->next = NULL;
+    if (zygote_queue_tail)
+	zygote_queue_tail->next = zreq;
+    else
+	zygote_queue = zreq;
+    zygote_queue_tail = zreq;
+    
+    return TRUE;
+}
+
+
+static struct client_data *find_client_by_connid(int connid)
+{
+    struct client_data *client;
+    
+    for (client = connected_list_head.next; client; client = client->next)
+	if (client->connid == connid)
+	    return client;
+    for (client = disconnected_list_head.next; client; client = client->next)
+	if (client->connid == connid)
+	    return client;
+    return NULL;
+}
+
+
+/*
+ * Collect game process pids from the zygote. It answers in the order the games
+ * were sent, so each pid belongs to the oldest queued game. A game whose
+ * client is gone already needs nothing: its pipes are closed, so it exits.
+ */
+static void zygote_event(int epfd, unsigned int event_mask)
+{
+    struct zygote_request *zreq;
+    struct client_data *client;
+    int ret, pid, closed;
+    
+    closed = (event_mask & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)) != 0;
+    
+    while (zygote_queue) {
+	ret = recv(zygote_fd, &pid, sizeof(pid), MSG_DONTWAIT);
+	if (ret == -1 && errno == EINTR)
+	    continue;
+	else if (ret != sizeof(pid)) {
+	    if (ret == 0 || (ret == -1 && errno != EAGAIN && errno != EWOULDBLOCK))
+		closed = TRUE;
+	    break;
+	}
+	
+	zreq = zygote_queue;
+	zygote_queue = zreq->next;
+	if (!zygote_queue)
+	    zygote_queue_tail = NULL;
+	
+	client = find_client_by_connid(zreq->connid);
+	if (pid <= 0)
+	    /* nothing holds the game end of the pipes any more, so the
+	     * client is cleaned up when they close */
+	    log_msg("The zygote failed to start a game process for user %d",
+		    client ? client->userid : 0);
+	else if (client && !client->pid)
+	    client->pid = pid;
+	free(zreq);
+    }
+    
+    if (closed) {
+	log_msg("Zygote at pid %d has exited; forking game processes "
+		"directly from now on.", zygote_pid);
+	zygote_pid = 0; /* reaped by the main loop */
+	stop_zygote(epfd);
+    }
+}
+
+
 /*
  * A new game process is needed.
  * Create the communication pipes, register them with epoll and fork the new
@@ -274,7 +977,10 @@ static int fork_client(struct client_data *client, int epfd)
     int pipe_out_fd[2];
     int pipe_in_fd[2];
     struct epoll_event ev;
+    struct timeval start, forked;
+    long long usec;
     
+    gettimeofday(&start, NULL);
     ret1 = pipe2(pipe_out_fd, O_NONBLOCK);
     ret2 = pipe2(pipe_in_fd, O_NONBLOCK);
     if (ret1 == -1 || ret2 == -1) {
@@ -301,14 +1007,21 @@ static int fork_client(struct client_data *client, int epfd)
     map_fd_to_client(client->pipe_out, client);
     map_fd_to_client(client->pipe_in, client);
     
-    client->pid = fork();
-    if (client->pid > 0) { /* parent */
-    } else if (client->pid == 0) { /* child */
-	userid = client->userid;
-	post_fork_cleanup();
-	client_main(userid, pipe_out_fd[0], pipe_in_fd[1]);
-	exit(0); /* shouldn't get here... client is done. */
-    } else if (client->pid == -1) { /* error */
+    if (zygote_fd != -1 &&
+	zygote_fork_client(client, pipe_out_fd[0], pipe_in_fd[1], epfd))
+	client->pid = 0; /* not known yet, see zygote_event */
+    else {
+	gettimeofday(&forked, NULL);
+	client->pid = fork();
+	if (client->pid == 0) { /* child */
+	    userid = client->userid;
+	    post_fork_cleanup();
+	    log_game_start(&forked, "fork");
+	    client_main(userid, pipe_out_fd[0], pipe_in_fd[1]);
+	    exit(0); /* shouldn't get here... client is done. */
+	}
+    }
+    if (client->pid == -1) { /* error */
 	/* can't proceed, so clean up. The client side of the pipes needs to be
 	 * closed here, this end gets handled in cleanup_game_process */
 	close(pipe_out_fd[0]);
@@ -334,10 +1047,27 @@ static int fork_client(struct client_data *client, int epfd)
     close(pipe_out_fd[0]);
     close(pipe_in_fd[1]);
     
+    usec = usec_since(&start);
+    spawn_stats.count++;
+    spawn_stats.total_usec += usec;
+    if (usec > spawn_stats.max_usec)
+	spawn_stats.max_usec = usec;
+    
     return TRUE;
 }
 
 
+static void report_spawn_stats(void)
+{
+    if (!spawn_stats.count)
+	return;
+    log_msg("Started %ld game processes; the master spent %lld us on average, "
+	    "%lld us max.",
+	    spawn_stats.count, spawn_stats.total_usec / spawn_stats.count,
+	    spawn_stats.max_usec);
+}
+
+
 /*
  * Accept and authenticate a new client connection on one of the listening sockets.
  */
@@ -379,12 +1109,11 @@ static void server_socket_event(int server_fd, int epfd)
 static void handle_new_connection(int newfd, int epfd)
 {
     struct epoll_event ev;
-    struct client_data *client;
     struct sockaddr_storage addr;
     socklen_t addrlen = sizeof(addr);
     char authbuf[AUTHBUFSIZE];
-    int pos, is_reg, reconnect_id, authlen, userid;
-    static int connection_id = 1;
+    struct auth_reply reply;
+    int pos, authlen;
     
     if (fd_to_client_max > newfd && fd_to_client[newfd] == &new_connection_dummy) {
 	epoll_ctl(epfd, EPOLL_CTL_DEL, newfd, &ev);
@@ -421,9 +1150,37 @@ static void handle_new_connection(int newfd, int epfd)
     }
     
     /*
-     * ready to authenticate the user here
+     * ready to authenticate the user: the database work happens in an auth
+     * worker, the result arrives via auth_worker_event.
      */
-    userid = auth_user(authbuf, addr2str(&addr), &is_reg, &reconnect_id);
+    if (queue_auth_request(newfd, authbuf, addr2str(&addr)))
+	return;
+    
+    /* no worker is available; better slow than not at all */
+    memset(&reply, 0, sizeof(reply));
+    reply.userid = auth_user(authbuf, addr2str(&addr), &reply.is_reg,
+			     &reply.reconnect_id);
+    finish_new_connection(newfd, &reply, epfd);
+}
+
+
+/*
+ * Act on the authentication result for a new connection: either reject it or
+ * attach it to a new or existing game process.
+ */
+static void finish_new_connection(int newfd, const struct auth_reply *reply, int epfd)
+{
+    struct epoll_event ev;
+    struct client_data *client;
+    struct sockaddr_storage addr;
+    socklen_t addrlen = sizeof(addr);
+    int is_reg = reply->is_reg, reconnect_id = reply->reconnect_id;
+    int userid = reply->userid;
+    static int connection_id = 1;
+    
+    memset(&addr, 0, addrlen);
+    getpeername(newfd, (struct sockaddr*)&addr, &addrlen);
+    
     if (userid <= 0) {
 	if (!userid)
 	    auth_send_result(newfd, AUTH_FAILED_UNKNOWN_USER, is_reg, 0);
@@ -785,6 +1542,7 @@ static int trigger_server_shutdown(struct timeval *tv, int *ipv4fd, int *ipv6fd,
     
     gettimeofday(tv, NULL);
     log_msg("Shutdown request received; %d clients active.", client_count);
+    report_spawn_stats();
     if (*ipv4fd != -1) {
 	close(*ipv4fd);
 	*ipv4fd = -1;
@@ -814,7 +1572,7 @@ static int trigger_server_shutdown(struct timeval *tv, int *ipv4fd, int *ipv6fd,
  */
 int runserver(void)
 {
-    int i, ipv4fd, ipv6fd, unixfd, epfd, nfds, timeout, fd, childstatus;
+    int i, j, ipv4fd, ipv6fd, unixfd, epfd, nfds, timeout, fd, childstatus;
     struct epoll_event events[MAX_EVENTS];
     struct client_data *client;
     struct timeval sigtime, curtime, tmp;
@@ -831,6 +1589,13 @@ int runserver(void)
     if (!setup_server_sockets(&ipv4fd, &ipv6fd, &unixfd, epfd))
 	return FALSE;
     
+    for (i = 0; i < AUTH_WORKERS; i++) {
+	auth_workers[i].fd = -1;
+	start_auth_worker(&auth_workers[i], epfd);
+    }
+    if (settings.zygote)
+	start_zygote(epfd);
+    
     /*
      * server event loop
      */
@@ -868,9 +1633,10 @@ int runserver(void)
 		goto finally;
 	}
 	else if (nfds == 0) { /* timeout */
-	    if (!termination_flag)
+	    if (!termination_flag) {
 		log_msg(" -- mark (no activity for 10 minutes) --");
-	    else /* shutdown timer has run out */
+		report_spawn_stats();
+	    } else /* shutdown timer has run out */
 		goto finally;
 	    continue;
 	}
@@ -884,6 +1650,21 @@ int runserver(void)
 		continue;
 	    }
 	    
+	    for (j = 0; j < AUTH_WORKERS; j++)
+		if (fd == auth_workers[j].fd)
+		    break;
+	    if (j < AUTH_WORKERS) {
+		/* login verdicts from an auth worker */
+		auth_worker_event(&auth_workers[j], epfd, events[i].events);
+		continue;
+	    }
+	    
+	    if (fd == zygote_fd && zygote_fd != -1) {
+		/* game process pids from the zygote */
+		zygote_event(epfd, events[i].events);
+		continue;
+	    }
+	    
 	    /* activity on a client socket or pipe */
 	    client = fd_to_client[fd];
 	    /* was this fd closed while handling a prior event? */
@@ -934,6 +1715,9 @@ int runserver(void)
     } /* while(1) */
 
 finally:
+    for (i = 0; i < AUTH_WORKERS; i++)
+	stop_auth_worker(&auth_workers[i], epfd);
+    stop_zygote(epfd);
     while (disconnected_list_head.next)
 	cleanup_game_process(disconnected_list_head.next, epfd);
     while (connected_list_head.next)
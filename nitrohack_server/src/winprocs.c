@@ -5,6 +5,7 @@
  */
 
 #include "nhserver.h"
+#include <zlib.h>
 
 
 static void srv_raw_print(const char *str);
@@ -46,6 +47,8 @@ static struct nh_dbuf_entry prev_dbuf[ROWNO][COLNO];
 static int prev_invent_icount, prev_floor_icount;
 static struct nh_objitem *prev_invent;
 static const struct nh_dbuf_entry zero_dbuf; /* an entry of all zeroes */
+static int dbuf_bin; /* the client asked for the compact map encoding */
+static int dbuf_keyframe; /* the client's map must be rebuilt from scratch */
 static json_t *display_data, *jinvent_items, *jfloor_items;
 static int altproc;
 
@@ -308,11 +311,148 @@ static void srv_print_message_nonblocking(int turn, const char *msg)
 }
 
 
+/*
+ * Compare a map cell with the version the client has and append the changed
+ * fields to the binary update. Returns the new end of the data or NULL if
+ * nothing changed.
+ */
+static unsigned char *pack_dbuf_delta(unsigned char *out,
+				      const struct nh_dbuf_entry *cur,
+				      const struct nh_dbuf_entry *old)
+{
+    unsigned char *p = out + 2;
+    int mask = 0;
+    
+#define PUT16(val) (p[0] = (val) & 0xff, p[1] = ((val) >> 8) & 0xff, p += 2)
+#define PACK16(field, bit) \
+    if (cur->field != old->field) { mask |= (bit); PUT16(cur->field); }
+    
+    if (cur->effect != old->effect) {
+	mask |= DBUF_BIN_F_EFFECT;
+	PUT16(cur->effect);
+	PUT16(cur->effect >> 16);
+    }
+    PACK16(bg, DBUF_BIN_F_BG)
+    PACK16(trap, DBUF_BIN_F_TRAP)
+    PACK16(obj, DBUF_BIN_F_OBJ)
+    PACK16(obj_mn, DBUF_BIN_F_OBJ_MN)
+    PACK16(objflags, DBUF_BIN_F_OBJFLAGS)
+    PACK16(mon, DBUF_BIN_F_MON)
+    PACK16(monflags, DBUF_BIN_F_MONFLAGS)
+    if (cur->invis != old->invis) {
+	mask |= DBUF_BIN_F_INVIS;
+	*p++ = cur->invis;
+    }
+    PACK16(dgnflags, DBUF_BIN_F_DGNFLAGS)
+    
+#undef PACK16
+#undef PUT16
+    
+    if (!mask)
+	return NULL;
+    out[0] = mask & 0xff;
+    out[1] = mask >> 8;
+    return p;
+}
+
+
+static void base64_encode(const unsigned char *in, int len, char *out)
+{
+    static const char b64[] =
+	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    unsigned int v;
+    int i;
+    
+    for (i = 0; i + 2 < len; i += 3) {
+	v = (in[i] << 16) | (in[i+1] << 8) | in[i+2];
+	*out++ = b64[v >> 18];
+	*out++ = b64[(v >> 12) & 63];
+	*out++ = b64[(v >> 6) & 63];
+	*out++ = b64[v & 63];
+    }
+    if (i < len) {
+	v = in[i] << 16;
+	if (i + 1 < len)
+	    v |= in[i+1] << 8;
+	*out++ = b64[v >> 18];
+	*out++ = b64[(v >> 12) & 63];
+	*out++ = i + 1 < len ? b64[(v >> 6) & 63] : '=';
+	*out++ = '=';
+    }
+    *out = '\0';
+}
+
+
+/*
+ * The compact form of srv_update_screen: a bitmask of changed cells and the
+ * changed fields of each, see nitrohack_client.h. Building it needs no json
+ * objects per cell.
+ */
+static void srv_update_screen_bin(struct nh_dbuf_entry dbuf[ROWNO][COLNO], int ux, int uy)
+{
+    static unsigned char payload[DBUF_BIN_PAYLOAD_MAX];
+    static unsigned char msg[DBUF_BIN_HEADER_LEN + DBUF_BIN_PAYLOAD_MAX + 64];
+    static char b64[(sizeof(msg) + 2) / 3 * 4 + 1];
+    unsigned char *p, *end;
+    uLongf zlen;
+    int x, y, i, len, changed = 0;
+    
+    memset(payload, 0, DBUF_BIN_MASK_LEN);
+    p = payload + DBUF_BIN_MASK_LEN;
+    for (y = 0; y < ROWNO; y++)
+	for (x = 0; x < COLNO; x++) {
+	    end = pack_dbuf_delta(p, &dbuf[y][x],
+				  dbuf_keyframe ? &zero_dbuf : &prev_dbuf[y][x]);
+	    if (!end)
+		continue;
+	    i = y * COLNO + x;
+	    payload[i >> 3] |= 1 << (i & 7);
+	    p = end;
+	    changed++;
+	}
+    
+    if (!changed && !dbuf_keyframe)
+	return; /* no point in sending out a message that nothing changed */
+    
+    len = p - payload;
+    msg[0] = dbuf_keyframe ? DBUF_BIN_KEYFRAME : 0;
+    msg[1] = len & 0xff;
+    msg[2] = len >> 8;
+    zlen = sizeof(msg) - DBUF_BIN_HEADER_LEN;
+    if (compress(msg + DBUF_BIN_HEADER_LEN, &zlen, payload, len) == Z_OK &&
+	zlen < len) {
+	msg[0] |= DBUF_BIN_ZLIB;
+	len = zlen;
+    } else
+	memcpy(msg + DBUF_BIN_HEADER_LEN, payload, len);
+    
+    base64_encode(msg, DBUF_BIN_HEADER_LEN + len, b64);
+    add_display_data("update_screen", json_pack("{si,si,ss}", "ux", ux, "uy", uy,
+						"dbuf_bin", b64));
+    dbuf_keyframe = FALSE;
+}
+
+
+/* Switch between the json and the compact map encoding. */
+void srv_set_dbuf_encoding(int binary)
+{
+    dbuf_bin = binary;
+    dbuf_keyframe = TRUE; /* don't rely on the client's copy of the map */
+}
+
+
 static void srv_update_screen(struct nh_dbuf_entry dbuf[ROWNO][COLNO], int ux, int uy)
 {
     int i, x, y, samedbe, samecols, zerodbe, zerocols, is_same, is_zero;
     json_t *jmsg, *jdbuf, *dbufcol, *dbufent;
     
+    if (dbuf_bin) {
+	srv_update_screen_bin(dbuf, ux, uy);
+	for (i = 0; i < ROWNO; i++)
+	    memcpy(&prev_dbuf[i], &dbuf[i], sizeof(dbuf[i]));
+	return;
+    }
+    
     samecols = 0;
     zerocols = 0;
     jdbuf = json_array();
@@ -724,6 +864,7 @@ void reset_cached_diplaydata(void)
     
     memset(&player_info, 0, sizeof(player_info));
     memset(&prev_dbuf, 0, sizeof(prev_dbuf));
+    dbuf_keyframe = TRUE;
 }
 
 /* winprocs.c */